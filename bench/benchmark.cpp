@@ -0,0 +1,195 @@
+//
+// Frame-time benchmark: per-frame CPU and GPU times plus summary statistics.
+//
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+TimingSummary summarizeTimings(std::vector<double> samples_ms) {
+    TimingSummary summary;
+    if (samples_ms.empty())
+        return summary;
+
+    std::sort(samples_ms.begin(), samples_ms.end());
+    size_t n = samples_ms.size();
+    // Nearest-rank percentile: smallest sample with at least p% at or below it
+    auto percentile = [&](double p) {
+        size_t rank = (size_t) std::ceil(p * n);
+        return samples_ms[rank > 0 ? rank - 1 : 0];
+    };
+
+    double sum = 0.0;
+    for (double sample : samples_ms)
+        sum += sample;
+
+    summary.min_ms = samples_ms.front();
+    summary.median_ms = percentile(0.5);
+    summary.p99_ms = percentile(0.99);
+    summary.max_ms = samples_ms.back();
+    summary.mean_ms = sum / n;
+    return summary;
+}
+
+void FrameBenchmark::beginFrame() {
+    frame_start = std::chrono::steady_clock::now();
+    if (cpu_ms.empty())
+        run_start = frame_start;
+}
+
+void FrameBenchmark::endFrame() {
+    auto frame_end = std::chrono::steady_clock::now();
+    cpu_ms.push_back(std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+}
+
+void FrameBenchmark::finish() {
+    // Wall time includes the GPU catching up with the last frames
+    glFinish();
+    if (!cpu_ms.empty())
+        total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+}
+
+void FrameBenchmark::setGpuFrameTimes(const std::vector<double> &samples_ms) {
+    gpu_ms = samples_ms;
+    gpu_timing = true;
+}
+
+double FrameBenchmark::framesPerSecond() const {
+    return total_seconds > 0.0 ? cpu_ms.size() / total_seconds : 0.0;
+}
+
+void FrameBenchmark::setInfo(const std::string &key, const std::string &value) {
+    info.emplace_back(key, value);
+}
+
+void FrameBenchmark::addGpuPass(const std::string &name, const std::vector<double> &samples_ms) {
+    gpu_pass_ms.emplace_back(name, samples_ms);
+}
+
+void FrameBenchmark::printSummary(FILE *fp) const {
+    TimingSummary cpu = summarizeTimings(cpu_ms);
+    fprintf(fp, "Benchmark: %zu frames, %.1f fps\n", cpu_ms.size(), framesPerSecond());
+    fprintf(fp, "  CPU ms: min %.3f  median %.3f  p99 %.3f  max %.3f\n",
+            cpu.min_ms, cpu.median_ms, cpu.p99_ms, cpu.max_ms);
+    if (gpu_timing) {
+        TimingSummary gpu = summarizeTimings(gpu_ms);
+        fprintf(fp, "  GPU ms: min %.3f  median %.3f  p99 %.3f  max %.3f\n",
+                gpu.min_ms, gpu.median_ms, gpu.p99_ms, gpu.max_ms);
+    } else {
+        fprintf(fp, "  GPU ms: n/a (no timer query support)\n");
+    }
+    for (const auto &pass : gpu_pass_ms) {
+        TimingSummary gpu = summarizeTimings(pass.second);
+        fprintf(fp, "    %-16s min %.3f  median %.3f  p99 %.3f  max %.3f\n", (pass.first + ":").c_str(),
+                gpu.min_ms, gpu.median_ms, gpu.p99_ms, gpu.max_ms);
+    }
+}
+
+bool FrameBenchmark::writeReport(const char *path) const {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+
+    size_t length = strlen(path);
+    bool json = length >= 5 && !strcmp(path + length - 5, ".json");
+    bool ok = json ? writeJSON(fp) : writeCSV(fp);
+    fclose(fp);
+
+    if (ok)
+        printf("Benchmark results written to %s\n", path);
+    return ok;
+}
+
+// `text` as a quoted JSON string (renderer names and the like may hold
+// quotes or backslashes)
+static std::string jsonString(const std::string &text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char) c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+static void writeSummaryJSON(FILE *fp, const std::string &name, const TimingSummary &s) {
+    fprintf(fp, "    %s: {\"min_ms\": %.6f, \"median_ms\": %.6f, \"p99_ms\": %.6f, "
+                "\"max_ms\": %.6f, \"mean_ms\": %.6f}",
+            jsonString(name).c_str(), s.min_ms, s.median_ms, s.p99_ms, s.max_ms, s.mean_ms);
+}
+
+static void writeSamplesJSON(FILE *fp, const std::string &name, const std::vector<double> &samples) {
+    fprintf(fp, "    %s: [", jsonString(name).c_str());
+    for (size_t i = 0; i < samples.size(); i++)
+        fprintf(fp, "%s%.6f", i ? ", " : "", samples[i]);
+    fprintf(fp, "]");
+}
+
+bool FrameBenchmark::writeJSON(FILE *fp) const {
+    fprintf(fp, "{\n  \"info\": {");
+    for (size_t i = 0; i < info.size(); i++)
+        fprintf(fp, "%s\n    %s: %s", i ? "," : "", jsonString(info[i].first).c_str(),
+                jsonString(info[i].second).c_str());
+    fprintf(fp, "\n  },\n");
+
+    fprintf(fp, "  \"frames\": %zu,\n  \"fps\": %.3f,\n", cpu_ms.size(), framesPerSecond());
+    fprintf(fp, "  \"summary\": {\n");
+    writeSummaryJSON(fp, "cpu", summarizeTimings(cpu_ms));
+    if (gpu_timing) {
+        fprintf(fp, ",\n");
+        writeSummaryJSON(fp, "gpu", summarizeTimings(gpu_ms));
+    }
+    for (const auto &pass : gpu_pass_ms) {
+        fprintf(fp, ",\n");
+        writeSummaryJSON(fp, "gpu:" + pass.first, summarizeTimings(pass.second));
+    }
+    fprintf(fp, "\n  },\n  \"samples\": {\n");
+    writeSamplesJSON(fp, "cpu_ms", cpu_ms);
+    if (gpu_timing) {
+        fprintf(fp, ",\n");
+        writeSamplesJSON(fp, "gpu_ms", gpu_ms);
+    }
+    for (const auto &pass : gpu_pass_ms) {
+        fprintf(fp, ",\n");
+        writeSamplesJSON(fp, "gpu_ms:" + pass.first, pass.second);
+    }
+    fprintf(fp, "\n  }\n}\n");
+
+    return !ferror(fp);
+}
+
+// One row per timer, easy to append to a spreadsheet tracking builds. The
+// info comes first as "# key=value" comment lines, so runs of different
+// configurations can still be told apart.
+bool FrameBenchmark::writeCSV(FILE *fp) const {
+    for (const auto &entry : info)
+        fprintf(fp, "# %s=%s\n", entry.first.c_str(), entry.second.c_str());
+    fprintf(fp, "timer,frames,fps,min_ms,median_ms,p99_ms,max_ms,mean_ms\n");
+
+    TimingSummary cpu = summarizeTimings(cpu_ms);
+    fprintf(fp, "cpu,%zu,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f\n", cpu_ms.size(), framesPerSecond(),
+            cpu.min_ms, cpu.median_ms, cpu.p99_ms, cpu.max_ms, cpu.mean_ms);
+    if (gpu_timing) {
+        TimingSummary gpu = summarizeTimings(gpu_ms);
+        fprintf(fp, "gpu,%zu,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f\n", gpu_ms.size(), framesPerSecond(),
+                gpu.min_ms, gpu.median_ms, gpu.p99_ms, gpu.max_ms, gpu.mean_ms);
+    }
+    for (const auto &pass : gpu_pass_ms) {
+        TimingSummary gpu = summarizeTimings(pass.second);
+        fprintf(fp, "gpu:%s,%zu,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f\n", pass.first.c_str(), pass.second.size(),
+                framesPerSecond(), gpu.min_ms, gpu.median_ms, gpu.p99_ms, gpu.max_ms, gpu.mean_ms);
+    }
+
+    return !ferror(fp);
+}
@@ -0,0 +1,67 @@
+//
+// Frame-time benchmark: per-frame CPU and GPU times plus summary statistics.
+//
+
+#ifndef GL_TEST_BENCHMARK_H
+#define GL_TEST_BENCHMARK_H
+
+#include <GL/glew.h>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct TimingSummary {
+    double min_ms = 0.0;
+    double median_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+// Nearest-rank statistics over a list of millisecond samples.
+TimingSummary summarizeTimings(std::vector<double> samples_ms);
+
+class FrameBenchmark {
+public:
+    // Brackets the work of one frame. CPU time is the wall clock time spent
+    // between both calls; nothing waits for the GPU, so frames overlap as
+    // they would outside the benchmark.
+    void beginFrame();
+    void endFrame();
+    // Waits for the frames still in flight: the run, and the frame rate,
+    // end there
+    void finish();
+
+    // GPU time of every frame, measured elsewhere (GpuPassTimer)
+    void setGpuFrameTimes(const std::vector<double> &samples_ms);
+
+    bool hasGpuTimes() const { return gpu_timing; }
+    size_t frameCount() const { return cpu_ms.size(); }
+    double framesPerSecond() const;
+
+    // Free-form key/value pairs written along with the results (renderer,
+    // viewport size, ...), handy to tell builds and machines apart.
+    void setInfo(const std::string &key, const std::string &value);
+
+    // GPU time of one render pass, sampled over the run (frames whose
+    // readback was dropped are missing, so counts may differ per pass)
+    void addGpuPass(const std::string &name, const std::vector<double> &samples_ms);
+
+    void printSummary(FILE *fp) const;
+    // Writes JSON if the path ends in ".json", CSV otherwise.
+    bool writeReport(const char *path) const;
+
+private:
+    bool writeJSON(FILE *fp) const;
+    bool writeCSV(FILE *fp) const;
+
+    bool gpu_timing = false;
+    std::vector<double> cpu_ms, gpu_ms;
+    std::vector<std::pair<std::string, std::string>> info;
+    std::vector<std::pair<std::string, std::vector<double>>> gpu_pass_ms;
+    std::chrono::steady_clock::time_point run_start, frame_start;
+    double total_seconds = 0.0;
+};
+
+#endif //GL_TEST_BENCHMARK_H
@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# Forward vs deferred shading over light counts and depth complexity (more
+# instances stack more objects behind each pixel). Run from bin/:
+#   ../bench/shading_sweep.sh [frames] [extra phong options...]
+#
+
+FRAMES=${1:-100}
+[ $# -gt 0 ] && shift
+
+LIGHTS="0 64 512 2048"
+INSTANCES="1 64 512 4096"
+
+printf "%-9s %6s %9s %7s %10s %10s\n" shading lights instances depth cpu_ms gpu_ms
+for instances in $INSTANCES; do
+    for lights in $LIGHTS; do
+        for shading in forward deferred; do
+            ./phong --headless --bench "$FRAMES" --shading $shading --lights $lights --instances $instances "$@" |
+            awk -v shading=$shading -v lights=$lights -v instances=$instances '
+                /CPU ms:/ { cpu = $6 }
+                /GPU ms:/ { gpu = ($3 == "n/a") ? "n/a" : $6 }
+                /Depth complexity:/ { depth = $3 }
+                END { printf "%-9s %6s %9s %7s %10s %10s\n", shading, lights, instances, depth, cpu, gpu }'
+        done
+    done
+done
@@ -0,0 +1,152 @@
+//
+// Microbenchmark: interleaved vs separate (one VBO per attribute) vertex
+// layouts. Renders a large vertex-bound mesh made of cube copies into a tiny
+// offscreen framebuffer so vertex fetch dominates, and times both layouts.
+//
+// Usage: vertex_layout_bench [iterations] [draws per iteration]
+//
+
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "../shapes/cube.h"
+#include "../render/headless.h"
+#include "../render/mesh.h"
+#include "benchmark.h"
+
+// Reads every attribute so none of them is optimised away
+static const char *bench_vs =
+        "#version 140\n"
+        "in vec3 v_pos;\n"
+        "in vec3 v_normal;\n"
+        "in vec2 v_tex;\n"
+        "out vec3 color;\n"
+        "void main() {\n"
+        "  gl_Position = vec4(v_pos * 0.01, 1.0);\n"
+        "  color = v_normal * 0.5 + 0.5 + vec3(v_tex, 0.0);\n"
+        "}\n";
+
+static const char *bench_fs =
+        "#version 140\n"
+        "in vec3 color;\n"
+        "out vec4 frag_col;\n"
+        "void main() {\n"
+        "  frag_col = vec4(color, 1.0);\n"
+        "}\n";
+
+static GLuint compileBenchProgram() {
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 1, &bench_vs, NULL);
+    glCompileShader(vs);
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fs, 1, &bench_fs, NULL);
+    glCompileShader(fs);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    bindVertexAttributes(program);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        printf("ERROR: Shader Program linking failed!\n%s\n", infoLog);
+        return 0;
+    }
+
+    return program;
+}
+
+// As many cube copies as 16-bit indices can address, spread on a grid
+static Mesh createCubeField(VertexLayout layout) {
+    Cube cube;
+    const int copies = 65536 / Cube::VERTEX_COUNT;
+
+    std::vector<GLfloat> positions, normals, uvs;
+    std::vector<GLushort> indices;
+    for (int c = 0; c < copies; c++) {
+        GLfloat offset[3] = {(GLfloat) (c % 64) - 32.0f, (GLfloat) ((c / 64) % 64) - 32.0f, 0.0f};
+        for (int v = 0; v < Cube::VERTEX_COUNT; v++) {
+            for (int i = 0; i < 3; i++) {
+                positions.push_back(cube.getVertices()[v * 3 + i] + offset[i]);
+                normals.push_back(cube.getNormals()[v * 3 + i]);
+            }
+            uvs.push_back(cube.getUV()[v * 2]);
+            uvs.push_back(cube.getUV()[v * 2 + 1]);
+        }
+        for (int i = 0; i < Cube::INDEX_COUNT; i++)
+            indices.push_back((GLushort) (c * Cube::VERTEX_COUNT + cube.getIndices()[i]));
+    }
+
+    return createMesh(positions.data(), normals.data(), uvs.data(), copies * Cube::VERTEX_COUNT,
+                      indices.data(), (int) indices.size(), layout);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+    int draws = argc > 2 ? atoi(argv[2]) : 20;
+    const int size = 16; // tiny viewport: keep the run vertex bound
+
+    if (!headlessCreateContext())
+        return 1;
+    GLenum glew_status = glewInit();
+    if (glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY) {
+        fprintf(stderr, "ERROR: could not start GLEW: %s\n", glewGetErrorString(glew_status));
+        return 1;
+    }
+    if (!headlessCreateFramebuffer(size, size))
+        return 1;
+    printf("Renderer: %s\n", glGetString(GL_RENDERER));
+
+    GLuint program = compileBenchProgram();
+    if (!program)
+        return 1;
+    glUseProgram(program);
+    glViewport(0, 0, size, size);
+    glEnable(GL_DEPTH_TEST);
+
+    VertexLayout layouts[2] = {VERTEX_LAYOUT_SEPARATE, VERTEX_LAYOUT_INTERLEAVED};
+    Mesh meshes[2];
+    for (int l = 0; l < 2; l++)
+        meshes[l] = createCubeField(layouts[l]);
+    printf("Mesh: %d vertices, %d indices; %d draws x %d iterations per layout\n",
+           meshes[0].vertex_count, meshes[0].index_count, draws, iterations);
+
+    // Alternate layouts every iteration so clock/thermal drift hits both
+    std::vector<double> times_ms[2];
+    for (int it = -1; it < iterations; it++) {
+        for (int l = 0; l < 2; l++) {
+            auto start = std::chrono::steady_clock::now();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (int d = 0; d < draws; d++)
+                drawMesh(meshes[l]);
+            glFinish();
+            auto end = std::chrono::steady_clock::now();
+            if (it >= 0) // first round only warms up
+                times_ms[l].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+    }
+
+    double vertices_per_iteration = (double) meshes[0].index_count * draws;
+    printf("%-12s %10s %10s %10s %14s\n", "layout", "min ms", "median ms", "p99 ms", "Mverts/s");
+    for (int l = 0; l < 2; l++) {
+        TimingSummary summary = summarizeTimings(times_ms[l]);
+        printf("%-12s %10.3f %10.3f %10.3f %14.1f\n", vertexLayoutName(layouts[l]),
+               summary.min_ms, summary.median_ms, summary.p99_ms,
+               vertices_per_iteration / (summary.median_ms * 1e3));
+        destroyMesh(meshes[l]);
+    }
+
+    glDeleteProgram(program);
+    headlessTerminate();
+
+    return 0;
+}
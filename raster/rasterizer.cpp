@@ -0,0 +1,431 @@
+//
+// CPU reference rasterizer: the Phong pipeline of the GL path (same vertex
+// transforms, same CalcPointLight) shaded 8 fragments at a time with simd.h.
+//
+
+#include "rasterizer.h"
+#include "simd.h"
+#include "../render/texture_cache.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+// Vertices are snapped to 1/256 pixel before setup
+static const float SUBPIXEL_SCALE = 256.0f;
+
+void rasterTextureFromImage(DecodedImage &image, RasterTexture &texture) {
+    if (image.levels.empty())
+        generateMipmaps(image);
+
+    const int c = image.components;
+    texture.levels.resize(image.levels.size());
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        RasterTexture::Level &dst = texture.levels[level];
+        dst.width = mipLevelWidth(image, (int) level);
+        dst.height = mipLevelHeight(image, (int) level);
+        dst.texels.resize((size_t) dst.width * dst.height);
+
+        // Missing channels read as in GL: green and blue 0, alpha 1
+        const unsigned char *src = image.levels[level];
+        for (size_t i = 0; i < dst.texels.size(); i++, src += c) {
+            uint32_t r = src[0], g = c > 1 ? src[1] : 0, b = c > 2 ? src[2] : 0, a = c > 3 ? src[3] : 255;
+            dst.texels[i] = r | g << 8 | b << 16 | a << 24;
+        }
+    }
+}
+
+// Post-transform vertex, before the perspective division
+struct ClipVertex {
+    glm::vec4 clip;
+    glm::vec3 world, normal;
+    glm::vec2 uv;
+};
+
+static ClipVertex lerpVertex(const ClipVertex &a, const ClipVertex &b, float t) {
+    ClipVertex r;
+    r.clip = a.clip + (b.clip - a.clip) * t;
+    r.world = a.world + (b.world - a.world) * t;
+    r.normal = a.normal + (b.normal - a.normal) * t;
+    r.uv = a.uv + (b.uv - a.uv) * t;
+    return r;
+}
+
+static void setupTriangle(const ClipVertex *v[3], const RasterMaterial *material, int width, int height,
+                          std::vector<RasterTriangle> &triangles) {
+    float x[3], y[3], values[3][RASTER_ATTRIBUTE_COUNT];
+    for (int i = 0; i < 3; i++) {
+        float inv_w = 1.0f / v[i]->clip.w;
+        glm::vec3 ndc = glm::vec3(v[i]->clip) * inv_w;
+        x[i] = roundf((ndc.x * 0.5f + 0.5f) * width * SUBPIXEL_SCALE) / SUBPIXEL_SCALE;
+        y[i] = roundf((0.5f - ndc.y * 0.5f) * height * SUBPIXEL_SCALE) / SUBPIXEL_SCALE;
+
+        float *value = values[i];
+        value[RASTER_DEPTH] = ndc.z * 0.5f + 0.5f;
+        value[RASTER_INV_W] = inv_w;
+        for (int k = 0; k < 3; k++) {
+            value[RASTER_WORLD_X + k] = v[i]->world[k] * inv_w;
+            value[RASTER_NORMAL_X + k] = v[i]->normal[k] * inv_w;
+        }
+        value[RASTER_U] = v[i]->uv.x * inv_w;
+        value[RASTER_V] = v[i]->uv.y * inv_w;
+    }
+
+    // Twice the signed area; both windings are drawn (no face culling in the
+    // GL path either), clockwise ones are flipped
+    int i1 = 1, i2 = 2;
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area != 0.0f) || !std::isfinite(area))
+        return;
+    if (area < 0.0f) {
+        std::swap(i1, i2);
+        area = -area;
+    }
+    const int order[3] = {0, i1, i2};
+
+    RasterTriangle tri;
+    float min_x = std::min(x[0], std::min(x[1], x[2])), max_x = std::max(x[0], std::max(x[1], x[2]));
+    float min_y = std::min(y[0], std::min(y[1], y[2])), max_y = std::max(y[0], std::max(y[1], y[2]));
+    // Pixels whose centre (i + 0.5) lies inside the bounds
+    tri.min_x = std::max(0, (int) ceilf(min_x - 0.5f));
+    tri.min_y = std::max(0, (int) ceilf(min_y - 0.5f));
+    tri.max_x = std::min(width - 1, (int) floorf(max_x - 0.5f));
+    tri.max_y = std::min(height - 1, (int) floorf(max_y - 0.5f));
+    if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+        return;
+
+    for (int e = 0; e < 3; e++) {
+        int a = order[(e + 1) % 3], b = order[(e + 2) % 3];
+        tri.edge_a[e] = y[a] - y[b];
+        tri.edge_b[e] = x[b] - x[a];
+        bool a_first = y[a] < y[b] || (y[a] == y[b] && x[a] < x[b]);
+        tri.edge_ref_x[e] = a_first ? x[a] : x[b];
+        tri.edge_ref_y[e] = a_first ? y[a] : y[b];
+        // Left edges (inside to the right) and top edges (inside below) own
+        // the pixel centres lying exactly on them
+        tri.edge_owns_zero[e] = tri.edge_a[e] > 0.0f || (tri.edge_a[e] == 0.0f && tri.edge_b[e] > 0.0f);
+    }
+    tri.inv_area = 1.0f / area;
+
+    for (int k = 0; k < RASTER_ATTRIBUTE_COUNT; k++) {
+        float v0 = values[order[0]][k];
+        tri.attribute[k][0] = v0;
+        tri.attribute[k][1] = values[order[1]][k] - v0;
+        tri.attribute[k][2] = values[order[2]][k] - v0;
+    }
+
+    // Texture LOD from the ratio of the UV and screen areas, one per triangle
+    float du1 = v[order[1]]->uv.x - v[0]->uv.x, dv1 = v[order[1]]->uv.y - v[0]->uv.y;
+    float du2 = v[order[2]]->uv.x - v[0]->uv.x, dv2 = v[order[2]]->uv.y - v[0]->uv.y;
+    float uv_area = fabsf(du1 * dv2 - du2 * dv1);
+    tri.uv_lod = uv_area > 0.0f ? 0.5f * log2f(uv_area / area) : -64.0f;
+    tri.material = material;
+
+    triangles.push_back(tri);
+}
+
+// Clips against the near plane (z > -w) and sets up the remaining polygon as
+// a fan. The other planes are handled by the screen bounds and depth test.
+static void clipTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2,
+                         const RasterMaterial *material, int width, int height,
+                         std::vector<RasterTriangle> &triangles) {
+    const ClipVertex *in[3] = {&v0, &v1, &v2};
+    float d[3];
+    int inside = 0;
+    for (int i = 0; i < 3; i++) {
+        d[i] = in[i]->clip.z + in[i]->clip.w;
+        inside += d[i] > 0.0f;
+    }
+
+    if (inside == 3) {
+        setupTriangle(in, material, width, height, triangles);
+        return;
+    }
+    if (inside == 0)
+        return;
+
+    ClipVertex polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        if (d[i] > 0.0f)
+            polygon[count++] = *in[i];
+        if ((d[i] > 0.0f) != (d[j] > 0.0f))
+            polygon[count++] = lerpVertex(*in[i], *in[j], d[i] / (d[i] - d[j]));
+    }
+    for (int i = 1; i + 1 < count; i++) {
+        const ClipVertex *fan[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+        setupTriangle(fan, material, width, height, triangles);
+    }
+}
+
+void rasterSetupMesh(const RasterFrame &frame, const RasterMesh &mesh, const InstanceData *instances,
+                     size_t instance_count, const RasterMaterial *material, int width, int height,
+                     std::vector<RasterTriangle> &triangles) {
+    std::vector<ClipVertex> vertices(mesh.vertex_count);
+
+    for (size_t instance = 0; instance < instance_count; instance++) {
+        // Vertex shader
+        const InstanceData &data = instances[instance];
+        for (int i = 0; i < mesh.vertex_count; i++) {
+            glm::vec4 world = data.model * glm::vec4(mesh.positions[3 * i], mesh.positions[3 * i + 1],
+                                                     mesh.positions[3 * i + 2], 1.0f);
+            glm::vec3 normal(mesh.normals[3 * i], mesh.normals[3 * i + 1], mesh.normals[3 * i + 2]);
+
+            vertices[i].clip = frame.view_projection * world;
+            vertices[i].world = glm::vec3(world);
+            vertices[i].normal = glm::normalize(data.normal_to_world * normal);
+            vertices[i].uv = glm::vec2(mesh.uvs[2 * i], mesh.uvs[2 * i + 1]);
+        }
+
+        for (int i = 0; i + 2 < mesh.index_count; i += 3)
+            clipTriangle(vertices[mesh.indices[i]], vertices[mesh.indices[i + 1]], vertices[mesh.indices[i + 2]],
+                         material, width, height, triangles);
+    }
+}
+
+void rasterCreateTarget(RasterTarget &target, int width, int height) {
+    target.width = width;
+    target.height = height;
+    target.stride = (width + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH;
+    target.color.assign((size_t) target.stride * height, 0);
+    target.depth.assign((size_t) target.stride * height, 1.0f);
+}
+
+void rasterClear(RasterTarget &target, uint32_t color, float depth) {
+    std::fill(target.color.begin(), target.color.end(), color);
+    std::fill(target.depth.begin(), target.depth.end(), depth);
+}
+
+// Bilinear fetch with GL_REPEAT wrapping; colors in [0, 255]
+static void sampleBilinear(const RasterTexture::Level &level, vfloat u, vfloat v, vfloat rgb[3]) {
+    vfloat w((float) level.width), h((float) level.height);
+    vfloat x = (u - floor(u)) * w - vfloat(0.5f);
+    vfloat y = (v - floor(v)) * h - vfloat(0.5f);
+    vfloat x0 = floor(x), y0 = floor(y);
+    vfloat fx = x - x0, fy = y - y0;
+
+    // Texel indices are built in float, exact for any texture up to 2^24 texels
+    x0 = select(x0 < vfloat(0.0f), w - vfloat(1.0f), x0);
+    y0 = select(y0 < vfloat(0.0f), h - vfloat(1.0f), y0);
+    vfloat x1 = x0 + vfloat(1.0f), y1 = y0 + vfloat(1.0f);
+    x1 = select(x1 >= w, vfloat(0.0f), x1);
+    y1 = select(y1 >= h, vfloat(0.0f), y1);
+
+    const uint32_t *texels = level.texels.data();
+    vint t00 = gather(texels, toInt(mulAdd(y0, w, x0)));
+    vint t10 = gather(texels, toInt(mulAdd(y0, w, x1)));
+    vint t01 = gather(texels, toInt(mulAdd(y1, w, x0)));
+    vint t11 = gather(texels, toInt(mulAdd(y1, w, x1)));
+
+    for (int c = 0; c < 3; c++) {
+        vint mask(255);
+        vfloat c00 = toFloat((t00 >> (8 * c)) & mask), c10 = toFloat((t10 >> (8 * c)) & mask);
+        vfloat c01 = toFloat((t01 >> (8 * c)) & mask), c11 = toFloat((t11 >> (8 * c)) & mask);
+        vfloat top = mulAdd(fx, c10 - c00, c00);
+        vfloat bottom = mulAdd(fx, c11 - c01, c01);
+        rgb[c] = mulAdd(fy, bottom - top, top);
+    }
+}
+
+// GL_LINEAR_MIPMAP_LINEAR (GL_LINEAR when magnified); colors in [0, 1]
+static void sampleTexture(const RasterTexture &texture, float uv_lod, vfloat u, vfloat v, vfloat rgb[3]) {
+    const RasterTexture::Level &base = texture.levels[0];
+    float lod = uv_lod + 0.5f * log2f((float) base.width * base.height);
+    int last = (int) texture.levels.size() - 1;
+    lod = std::min(std::max(lod, 0.0f), (float) last);
+
+    int level = (int) lod;
+    float t = lod - level;
+    sampleBilinear(texture.levels[level], u, v, rgb);
+    if (t > 0.0f && level < last) {
+        vfloat next[3];
+        sampleBilinear(texture.levels[level + 1], u, v, next);
+        for (int c = 0; c < 3; c++)
+            rgb[c] = mulAdd(vfloat(t), next[c] - rgb[c], rgb[c]);
+    }
+    for (int c = 0; c < 3; c++)
+        rgb[c] = rgb[c] * vfloat(1.0f / 255.0f);
+}
+
+static inline vfloat interpolate(const RasterTriangle &tri, int attribute, vfloat l1, vfloat l2) {
+    const float *plane = tri.attribute[attribute];
+    return mulAdd(l2, vfloat(plane[2]), mulAdd(l1, vfloat(plane[1]), vfloat(plane[0])));
+}
+
+// Fragment shader: sum of CalcPointLight over every light, packed to RGBA8
+static vint shadeFragments(const RasterFrame &frame, const RasterTriangle &tri, vfloat l1, vfloat l2) {
+    vfloat w = vfloat(1.0f) / interpolate(tri, RASTER_INV_W, l1, l2);
+    vfloat pos[3], normal[3];
+    for (int k = 0; k < 3; k++) {
+        pos[k] = interpolate(tri, RASTER_WORLD_X + k, l1, l2) * w;
+        // Interpolated, not renormalised: same as vs_normal in the shader
+        normal[k] = interpolate(tri, RASTER_NORMAL_X + k, l1, l2) * w;
+    }
+    vfloat u = interpolate(tri, RASTER_U, l1, l2) * w;
+    vfloat v = interpolate(tri, RASTER_V, l1, l2) * w;
+
+    const RasterMaterial &material = *tri.material;
+    vfloat diffuse_map[3], specular_map[3];
+    sampleTexture(*material.diffuse, tri.uv_lod, u, v, diffuse_map);
+    sampleTexture(*material.specular, tri.uv_lod, u, v, specular_map);
+
+    vfloat view_dir[3];
+    for (int k = 0; k < 3; k++)
+        view_dir[k] = vfloat(frame.view_pos[k]) - pos[k];
+    vfloat inv_length = vfloat(1.0f) / sqrt(view_dir[0] * view_dir[0] + view_dir[1] * view_dir[1] + view_dir[2] * view_dir[2]);
+    for (int k = 0; k < 3; k++)
+        view_dir[k] = view_dir[k] * inv_length;
+
+    vfloat result[3] = {vfloat(0.0f), vfloat(0.0f), vfloat(0.0f)};
+    for (const RasterLight &light : frame.lights) {
+        // Diffuse
+        vfloat light_dir[3];
+        for (int k = 0; k < 3; k++)
+            light_dir[k] = vfloat(light.position[k]) - pos[k];
+        inv_length = vfloat(1.0f) / sqrt(light_dir[0] * light_dir[0] + light_dir[1] * light_dir[1] + light_dir[2] * light_dir[2]);
+        for (int k = 0; k < 3; k++)
+            light_dir[k] = light_dir[k] * inv_length;
+        vfloat n_dot_l = normal[0] * light_dir[0] + normal[1] * light_dir[1] + normal[2] * light_dir[2];
+        vfloat diff = max(n_dot_l, vfloat(0.0f));
+
+        // Specular: reflect(-light_dir, normal) = 2 * dot(n, l) * n - l
+        vfloat r_dot_v(0.0f);
+        for (int k = 0; k < 3; k++)
+            r_dot_v = mulAdd(view_dir[k], vfloat(2.0f) * n_dot_l * normal[k] - light_dir[k], r_dot_v);
+        vfloat spec = powi(max(r_dot_v, vfloat(0.0f)), material.shininess);
+
+        for (int k = 0; k < 3; k++) {
+            vfloat ambient = vfloat(light.ambient[k]) * diffuse_map[k];
+            vfloat diffuse = vfloat(light.diffuse[k]) * (diff * diffuse_map[k]);
+            vfloat specular = vfloat(light.specular[k]) * spec * specular_map[k];
+            result[k] += diffuse + ambient + specular;
+        }
+    }
+
+    // Unsigned normalized conversion, as the GL does for an RGBA8 target
+    vint color((int) 0xff000000u);
+    for (int k = 0; k < 3; k++)
+        color = color | (toInt(mulAdd(clamp(result[k], 0.0f, 1.0f), vfloat(255.0f), vfloat(0.5f))) << (8 * k));
+    return color;
+}
+
+// Scan-converts one triangle inside [x0, x1) x [y0, y1) (already clamped to
+// the target); returns the fragments that passed the depth test
+static uint64_t drawTriangle(RasterTarget &target, const RasterFrame &frame, const RasterTriangle &tri,
+                             int x0, int y0, int x1, int y1) {
+    int min_x = std::max(tri.min_x, x0), max_x = std::min(tri.max_x + 1, x1);
+    int min_y = std::max(tri.min_y, y0), max_y = std::min(tri.max_y + 1, y1);
+    if (min_x >= max_x || min_y >= max_y)
+        return 0;
+
+    const vfloat lanes = laneIndex();
+    vfloat edge_a[3], edge_ref_x[3];
+    for (int e = 0; e < 3; e++) {
+        edge_a[e] = vfloat(tri.edge_a[e]);
+        edge_ref_x[e] = vfloat(tri.edge_ref_x[e]);
+    }
+    vfloat inv_area(tri.inv_area);
+    vfloat span_min((float) min_x), span_max((float) max_x);
+
+    uint64_t shaded = 0;
+    int group_x0 = min_x / simd::WIDTH * simd::WIDTH;
+    for (int y = min_y; y < max_y; y++) {
+        float py = y + 0.5f;
+        vfloat row[3];
+        for (int e = 0; e < 3; e++)
+            row[e] = vfloat(tri.edge_b[e] * (py - tri.edge_ref_y[e]));
+
+        float *depth_row = &target.depth[(size_t) y * target.stride];
+        uint32_t *color_row = &target.color[(size_t) y * target.stride];
+        for (int x = group_x0; x < max_x; x += simd::WIDTH) {
+            vfloat px = lanes + vfloat(x + 0.5f);
+            vmask inside = (px > span_min) & (px < span_max);
+
+            vfloat edge[3];
+            for (int e = 0; e < 3; e++) {
+                edge[e] = mulAdd(edge_a[e], px - edge_ref_x[e], row[e]);
+                inside = inside & (tri.edge_owns_zero[e] ? edge[e] >= vfloat(0.0f) : edge[e] > vfloat(0.0f));
+            }
+            if (!any(inside))
+                continue;
+
+            // Early depth test (the shader does not write depth)
+            vfloat l1 = edge[1] * inv_area, l2 = edge[2] * inv_area;
+            vfloat z = interpolate(tri, RASTER_DEPTH, l1, l2);
+            vfloat depth = vfloat::load(depth_row + x);
+            vmask pass = inside & (z < depth);
+            int pass_bits = bits(pass);
+            if (!pass_bits)
+                continue;
+
+            select(pass, z, depth).store(depth_row + x);
+            vint color = shadeFragments(frame, tri, l1, l2);
+            select(pass, color, vint::load(color_row + x)).store(color_row + x);
+            shaded += __builtin_popcount(pass_bits);
+        }
+    }
+
+    return shaded;
+}
+
+void rasterDrawTriangles(RasterTarget &target, const RasterFrame &frame, const std::vector<RasterTriangle> &triangles,
+                         int x0, int y0, int x1, int y1, RasterStats *stats) {
+    rasterDrawTriangles(target, frame, triangles.data(), NULL, triangles.size(), x0, y0, x1, y1, stats);
+}
+
+void rasterDrawTriangles(RasterTarget &target, const RasterFrame &frame, const RasterTriangle *triangles,
+                         const uint32_t *indices, size_t count, int x0, int y0, int x1, int y1, RasterStats *stats) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, target.width);
+    y1 = std::min(y1, target.height);
+
+    for (size_t i = 0; i < count; i++) {
+        const RasterTriangle &tri = triangles[indices ? indices[i] : i];
+        uint64_t shaded = drawTriangle(target, frame, tri, x0, y0, x1, y1);
+        if (stats && shaded) {
+            stats->triangles++;
+            stats->fragments_shaded += shaded;
+        }
+    }
+}
+
+void rasterClearRect(RasterTarget &target, uint32_t color, float depth, int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, target.width);
+    y1 = std::min(y1, target.height);
+    for (int y = y0; y < y1; y++) {
+        size_t row = (size_t) y * target.stride;
+        std::fill(target.color.begin() + row + x0, target.color.begin() + row + x1, color);
+        std::fill(target.depth.begin() + row + x0, target.depth.begin() + row + x1, depth);
+    }
+}
+
+bool rasterWritePPM(const RasterTarget &target, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", target.width, target.height);
+    std::vector<unsigned char> row((size_t) target.width * 3);
+    for (int y = 0; y < target.height; y++) {
+        const uint32_t *src = &target.color[(size_t) y * target.stride];
+        for (int x = 0; x < target.width; x++) {
+            row[3 * x] = src[x] & 0xff;
+            row[3 * x + 1] = (src[x] >> 8) & 0xff;
+            row[3 * x + 2] = (src[x] >> 16) & 0xff;
+        }
+        fwrite(row.data(), 1, row.size(), fp);
+    }
+    fclose(fp);
+
+    return true;
+}
+
+const char *rasterInstructionSet() {
+    return simd::ISA;
+}
@@ -0,0 +1,126 @@
+//
+// CPU reference rasterizer: the Phong pipeline of the GL path (same vertex
+// transforms, same CalcPointLight) shaded 8 fragments at a time with simd.h.
+//
+// Frames are rendered in two steps: rasterSetupMesh() transforms, clips and
+// sets up every triangle of a mesh; rasterDrawTriangles() scan-converts,
+// depth-tests and shades them inside a rectangle of the target.
+//
+
+#ifndef GL_TEST_RASTERIZER_H
+#define GL_TEST_RASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "../render/instancing.h"
+#include "../render/texture_loader.h"
+
+// RGBA8 mip chain, rows bottom-up like the GL textures (t = 0 is row 0)
+struct RasterTexture {
+    struct Level {
+        int width = 0, height = 0;
+        std::vector<uint32_t> texels;
+    };
+    std::vector<Level> levels;
+};
+
+// Converts a decoded image and its mip chain (generated when missing).
+void rasterTextureFromImage(DecodedImage &image, RasterTexture &texture);
+
+struct RasterMaterial {
+    const RasterTexture *diffuse = NULL;
+    const RasterTexture *specular = NULL;
+    int shininess = 32; // integer, so pow() is done by repeated squaring
+};
+
+struct RasterLight {
+    glm::vec3 position, ambient, diffuse, specular;
+};
+
+// Per-frame constants: the CPU side of the Camera and Lights uniform blocks
+struct RasterFrame {
+    glm::mat4 view_projection;
+    glm::vec3 view_pos;
+    std::vector<RasterLight> lights;
+};
+
+// Non-owning view of an indexed mesh (the arrays of shapes/)
+struct RasterMesh {
+    const float *positions = NULL; // 3 floats per vertex
+    const float *normals = NULL;   // 3 floats per vertex
+    const float *uvs = NULL;       // 2 floats per vertex
+    int vertex_count = 0;
+    const unsigned short *indices = NULL;
+    int index_count = 0;
+};
+
+// Interpolated values: depth and 1/w are linear in screen space, the rest
+// are stored divided by w for perspective-correct interpolation
+enum RasterAttribute {
+    RASTER_DEPTH, RASTER_INV_W,
+    RASTER_WORLD_X, RASTER_WORLD_Y, RASTER_WORLD_Z,
+    RASTER_NORMAL_X, RASTER_NORMAL_Y, RASTER_NORMAL_Z,
+    RASTER_U, RASTER_V,
+    RASTER_ATTRIBUTE_COUNT
+};
+
+// Screen-space triangle (y down, pixel centres at +0.5), counter-clockwise
+// after setup so all three edge functions are positive inside.
+struct RasterTriangle {
+    // Edge i is opposite vertex i: E(p) = a * (p.x - ref_x) + b * (p.y - ref_y).
+    // Both triangles sharing an edge use the same reference vertex, so their
+    // edge functions are exact opposites and no pixel is drawn twice or missed.
+    float edge_a[3], edge_b[3], edge_ref_x[3], edge_ref_y[3];
+    bool edge_owns_zero[3]; // top-left fill rule
+    float inv_area;         // barycentric of vertex i = E_i * inv_area
+
+    // value = v0 + l1 * d1 + l2 * d2, with l1, l2 the barycentrics of vertices 1, 2
+    float attribute[RASTER_ATTRIBUTE_COUNT][3];
+
+    int min_x, min_y, max_x, max_y; // inclusive pixel bounds
+    float uv_lod;                   // log2 of texels per pixel for a 1x1 texture
+    const RasterMaterial *material;
+};
+
+// Transforms every instance of `mesh`, clips against the near plane and
+// appends the visible triangles to `triangles`.
+void rasterSetupMesh(const RasterFrame &frame, const RasterMesh &mesh, const InstanceData *instances,
+                     size_t instance_count, const RasterMaterial *material, int width, int height,
+                     std::vector<RasterTriangle> &triangles);
+
+// Color (RGBA8, top row first) and depth buffers. Rows are padded to a
+// multiple of 8 pixels so every lane group loads and stores whole vectors.
+struct RasterTarget {
+    int width = 0, height = 0, stride = 0;
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+};
+
+void rasterCreateTarget(RasterTarget &target, int width, int height);
+void rasterClear(RasterTarget &target, uint32_t color, float depth = 1.0f);
+
+// Clears the pixels in [x0, x1) x [y0, y1) only.
+void rasterClearRect(RasterTarget &target, uint32_t color, float depth, int x0, int y0, int x1, int y1);
+
+struct RasterStats {
+    uint64_t triangles = 0;        // triangles that covered at least one pixel (of each rectangle drawn)
+    uint64_t fragments_shaded = 0; // fragments that passed the depth test
+};
+
+// Draws `triangles` in order, restricted to the pixels in [x0, x1) x [y0, y1).
+void rasterDrawTriangles(RasterTarget &target, const RasterFrame &frame, const std::vector<RasterTriangle> &triangles,
+                         int x0, int y0, int x1, int y1, RasterStats *stats = NULL);
+
+// Same, for the `count` triangles triangles[indices[i]] (a tile's bin).
+void rasterDrawTriangles(RasterTarget &target, const RasterFrame &frame, const RasterTriangle *triangles,
+                         const uint32_t *indices, size_t count, int x0, int y0, int x1, int y1,
+                         RasterStats *stats = NULL);
+
+bool rasterWritePPM(const RasterTarget &target, const char *path);
+
+// Instruction set the rasterizer was built for ("AVX2", "SSE2" or "scalar")
+const char *rasterInstructionSet();
+
+#endif //GL_TEST_RASTERIZER_H
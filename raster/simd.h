@@ -0,0 +1,288 @@
+//
+// 8-wide SIMD vectors for the CPU rasterizer: AVX2, SSE2 or plain scalar code
+// behind one interface, picked at compile time.
+//
+// vfloat/vint/vmask always hold 8 lanes. Narrower instruction sets use
+// several native registers per vector (two with SSE2, eight scalars
+// otherwise), so the rasterizer is written once for 8 fragments at a time.
+//
+
+#ifndef GL_TEST_SIMD_H
+#define GL_TEST_SIMD_H
+
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+namespace simd {
+
+const int WIDTH = 8;
+
+// Native registers: F (float), I (int32) and M (lane mask) of NATIVE_WIDTH lanes
+#if defined(SIMD_AVX2)
+
+const char *const ISA = "AVX2";
+const int NATIVE_WIDTH = 8;
+typedef __m256 F;
+typedef __m256i I;
+typedef __m256 M;
+
+inline F fSet1(float a) { return _mm256_set1_ps(a); }
+inline F fLoad(const float *p) { return _mm256_loadu_ps(p); }
+inline void fStore(float *p, F a) { _mm256_storeu_ps(p, a); }
+inline F fAdd(F a, F b) { return _mm256_add_ps(a, b); }
+inline F fSub(F a, F b) { return _mm256_sub_ps(a, b); }
+inline F fMul(F a, F b) { return _mm256_mul_ps(a, b); }
+inline F fDiv(F a, F b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+inline F fMulAdd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+inline F fMulAdd(F a, F b, F c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+inline F fMin(F a, F b) { return _mm256_min_ps(a, b); }
+inline F fMax(F a, F b) { return _mm256_max_ps(a, b); }
+inline F fSqrt(F a) { return _mm256_sqrt_ps(a); }
+inline F fFloor(F a) { return _mm256_floor_ps(a); }
+inline M fLt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline M fLe(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline M fGt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline M fGe(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline F fSelect(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+inline I fToInt(F a) { return _mm256_cvttps_epi32(a); }
+
+inline I iSet1(int a) { return _mm256_set1_epi32(a); }
+inline I iLoad(const uint32_t *p) { return _mm256_loadu_si256((const __m256i *) p); }
+inline void iStore(uint32_t *p, I a) { _mm256_storeu_si256((__m256i *) p, a); }
+inline I iAdd(I a, I b) { return _mm256_add_epi32(a, b); }
+inline I iAnd(I a, I b) { return _mm256_and_si256(a, b); }
+inline I iOr(I a, I b) { return _mm256_or_si256(a, b); }
+inline I iShl(I a, int n) { return _mm256_slli_epi32(a, n); }
+inline I iShr(I a, int n) { return _mm256_srli_epi32(a, n); }
+inline I iSelect(M m, I a, I b) {
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m));
+}
+inline F iToFloat(I a) { return _mm256_cvtepi32_ps(a); }
+inline I iGather(const uint32_t *base, I index) { return _mm256_i32gather_epi32((const int *) base, index, 4); }
+
+inline M mAnd(M a, M b) { return _mm256_and_ps(a, b); }
+inline M mOr(M a, M b) { return _mm256_or_ps(a, b); }
+inline M mAndNot(M a, M b) { return _mm256_andnot_ps(a, b); }
+inline int mBits(M a) { return _mm256_movemask_ps(a); }
+
+#elif defined(SIMD_SSE2)
+
+const char *const ISA = "SSE2";
+const int NATIVE_WIDTH = 4;
+typedef __m128 F;
+typedef __m128i I;
+typedef __m128 M;
+
+inline F fSet1(float a) { return _mm_set1_ps(a); }
+inline F fLoad(const float *p) { return _mm_loadu_ps(p); }
+inline void fStore(float *p, F a) { _mm_storeu_ps(p, a); }
+inline F fAdd(F a, F b) { return _mm_add_ps(a, b); }
+inline F fSub(F a, F b) { return _mm_sub_ps(a, b); }
+inline F fMul(F a, F b) { return _mm_mul_ps(a, b); }
+inline F fDiv(F a, F b) { return _mm_div_ps(a, b); }
+inline F fMulAdd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline F fMin(F a, F b) { return _mm_min_ps(a, b); }
+inline F fMax(F a, F b) { return _mm_max_ps(a, b); }
+inline F fSqrt(F a) { return _mm_sqrt_ps(a); }
+inline M fLt(F a, F b) { return _mm_cmplt_ps(a, b); }
+inline M fLe(F a, F b) { return _mm_cmple_ps(a, b); }
+inline M fGt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+inline M fGe(F a, F b) { return _mm_cmpge_ps(a, b); }
+inline F fSelect(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline F fFloor(F a) {
+    // No roundps before SSE4.1: truncate, then step down negative non-integers
+    F t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+inline I fToInt(F a) { return _mm_cvttps_epi32(a); }
+
+inline I iSet1(int a) { return _mm_set1_epi32(a); }
+inline I iLoad(const uint32_t *p) { return _mm_loadu_si128((const __m128i *) p); }
+inline void iStore(uint32_t *p, I a) { _mm_storeu_si128((__m128i *) p, a); }
+inline I iAdd(I a, I b) { return _mm_add_epi32(a, b); }
+inline I iAnd(I a, I b) { return _mm_and_si128(a, b); }
+inline I iOr(I a, I b) { return _mm_or_si128(a, b); }
+inline I iShl(I a, int n) { return _mm_slli_epi32(a, n); }
+inline I iShr(I a, int n) { return _mm_srli_epi32(a, n); }
+inline I iSelect(M m, I a, I b) {
+    I mi = _mm_castps_si128(m);
+    return _mm_or_si128(_mm_and_si128(mi, a), _mm_andnot_si128(mi, b));
+}
+inline F iToFloat(I a) { return _mm_cvtepi32_ps(a); }
+inline I iGather(const uint32_t *base, I index) {
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128((__m128i *) lanes, index);
+    return _mm_setr_epi32(base[lanes[0]], base[lanes[1]], base[lanes[2]], base[lanes[3]]);
+}
+
+inline M mAnd(M a, M b) { return _mm_and_ps(a, b); }
+inline M mOr(M a, M b) { return _mm_or_ps(a, b); }
+inline M mAndNot(M a, M b) { return _mm_andnot_ps(a, b); }
+inline int mBits(M a) { return _mm_movemask_ps(a); }
+
+#else
+
+const char *const ISA = "scalar";
+const int NATIVE_WIDTH = 1;
+typedef float F;
+typedef uint32_t I;
+typedef bool M;
+
+inline F fSet1(float a) { return a; }
+inline F fLoad(const float *p) { return *p; }
+inline void fStore(float *p, F a) { *p = a; }
+inline F fAdd(F a, F b) { return a + b; }
+inline F fSub(F a, F b) { return a - b; }
+inline F fMul(F a, F b) { return a * b; }
+inline F fDiv(F a, F b) { return a / b; }
+inline F fMulAdd(F a, F b, F c) { return a * b + c; }
+inline F fMin(F a, F b) { return b < a ? b : a; }
+inline F fMax(F a, F b) { return b > a ? b : a; }
+inline F fSqrt(F a) { return sqrtf(a); }
+inline F fFloor(F a) { return floorf(a); }
+inline M fLt(F a, F b) { return a < b; }
+inline M fLe(F a, F b) { return a <= b; }
+inline M fGt(F a, F b) { return a > b; }
+inline M fGe(F a, F b) { return a >= b; }
+inline F fSelect(M m, F a, F b) { return m ? a : b; }
+inline I fToInt(F a) { return (I) (int32_t) a; }
+
+inline I iSet1(int a) { return (I) a; }
+inline I iLoad(const uint32_t *p) { return *p; }
+inline void iStore(uint32_t *p, I a) { *p = a; }
+inline I iAdd(I a, I b) { return a + b; }
+inline I iAnd(I a, I b) { return a & b; }
+inline I iOr(I a, I b) { return a | b; }
+inline I iShl(I a, int n) { return a << n; }
+inline I iShr(I a, int n) { return a >> n; }
+inline I iSelect(M m, I a, I b) { return m ? a : b; }
+inline F iToFloat(I a) { return (F) (int32_t) a; }
+inline I iGather(const uint32_t *base, I index) { return base[index]; }
+
+inline M mAnd(M a, M b) { return a && b; }
+inline M mOr(M a, M b) { return a || b; }
+inline M mAndNot(M a, M b) { return !a && b; }
+inline int mBits(M a) { return a ? 1 : 0; }
+
+#endif
+
+const int PARTS = WIDTH / NATIVE_WIDTH;
+
+} // namespace simd
+
+#define SIMD_PARTS(r, expr) for (int k = 0; k < simd::PARTS; k++) r.p[k] = expr
+
+struct vfloat {
+    simd::F p[simd::PARTS];
+
+    vfloat() {}
+    vfloat(float a) { SIMD_PARTS((*this), simd::fSet1(a)); }
+
+    static vfloat load(const float *src) { vfloat r; SIMD_PARTS(r, simd::fLoad(src + k * simd::NATIVE_WIDTH)); return r; }
+    void store(float *dst) const {
+        for (int k = 0; k < simd::PARTS; k++)
+            simd::fStore(dst + k * simd::NATIVE_WIDTH, p[k]);
+    }
+};
+
+struct vint {
+    simd::I p[simd::PARTS];
+
+    vint() {}
+    vint(int a) { SIMD_PARTS((*this), simd::iSet1(a)); }
+
+    static vint load(const uint32_t *src) { vint r; SIMD_PARTS(r, simd::iLoad(src + k * simd::NATIVE_WIDTH)); return r; }
+    void store(uint32_t *dst) const {
+        for (int k = 0; k < simd::PARTS; k++)
+            simd::iStore(dst + k * simd::NATIVE_WIDTH, p[k]);
+    }
+};
+
+struct vmask {
+    simd::M p[simd::PARTS];
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fAdd(a.p[k], b.p[k])); return r; }
+inline vfloat operator-(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fSub(a.p[k], b.p[k])); return r; }
+inline vfloat operator*(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fMul(a.p[k], b.p[k])); return r; }
+inline vfloat operator/(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fDiv(a.p[k], b.p[k])); return r; }
+inline vfloat operator-(vfloat a) { return vfloat(0.0f) - a; }
+inline vfloat &operator+=(vfloat &a, vfloat b) { return a = a + b; }
+inline vfloat &operator*=(vfloat &a, vfloat b) { return a = a * b; }
+
+// a * b + c, fused when the instruction set has FMA
+inline vfloat mulAdd(vfloat a, vfloat b, vfloat c) { vfloat r; SIMD_PARTS(r, simd::fMulAdd(a.p[k], b.p[k], c.p[k])); return r; }
+inline vfloat min(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fMin(a.p[k], b.p[k])); return r; }
+inline vfloat max(vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fMax(a.p[k], b.p[k])); return r; }
+inline vfloat sqrt(vfloat a) { vfloat r; SIMD_PARTS(r, simd::fSqrt(a.p[k])); return r; }
+inline vfloat floor(vfloat a) { vfloat r; SIMD_PARTS(r, simd::fFloor(a.p[k])); return r; }
+inline vfloat clamp(vfloat a, float lo, float hi) { return min(max(a, vfloat(lo)), vfloat(hi)); }
+
+inline vmask operator<(vfloat a, vfloat b) { vmask r; SIMD_PARTS(r, simd::fLt(a.p[k], b.p[k])); return r; }
+inline vmask operator<=(vfloat a, vfloat b) { vmask r; SIMD_PARTS(r, simd::fLe(a.p[k], b.p[k])); return r; }
+inline vmask operator>(vfloat a, vfloat b) { vmask r; SIMD_PARTS(r, simd::fGt(a.p[k], b.p[k])); return r; }
+inline vmask operator>=(vfloat a, vfloat b) { vmask r; SIMD_PARTS(r, simd::fGe(a.p[k], b.p[k])); return r; }
+
+inline vmask operator&(vmask a, vmask b) { vmask r; SIMD_PARTS(r, simd::mAnd(a.p[k], b.p[k])); return r; }
+inline vmask operator|(vmask a, vmask b) { vmask r; SIMD_PARTS(r, simd::mOr(a.p[k], b.p[k])); return r; }
+// a & ~b
+inline vmask andNot(vmask a, vmask b) { vmask r; SIMD_PARTS(r, simd::mAndNot(b.p[k], a.p[k])); return r; }
+
+// One bit per lane, lane 0 in bit 0
+inline int bits(vmask m) {
+    int r = 0;
+    for (int k = 0; k < simd::PARTS; k++)
+        r |= simd::mBits(m.p[k]) << (k * simd::NATIVE_WIDTH);
+    return r;
+}
+inline bool any(vmask m) { return bits(m) != 0; }
+
+// m ? a : b, lane by lane
+inline vfloat select(vmask m, vfloat a, vfloat b) { vfloat r; SIMD_PARTS(r, simd::fSelect(m.p[k], a.p[k], b.p[k])); return r; }
+inline vint select(vmask m, vint a, vint b) { vint r; SIMD_PARTS(r, simd::iSelect(m.p[k], a.p[k], b.p[k])); return r; }
+
+inline vint operator+(vint a, vint b) { vint r; SIMD_PARTS(r, simd::iAdd(a.p[k], b.p[k])); return r; }
+inline vint operator&(vint a, vint b) { vint r; SIMD_PARTS(r, simd::iAnd(a.p[k], b.p[k])); return r; }
+inline vint operator|(vint a, vint b) { vint r; SIMD_PARTS(r, simd::iOr(a.p[k], b.p[k])); return r; }
+inline vint operator<<(vint a, int n) { vint r; SIMD_PARTS(r, simd::iShl(a.p[k], n)); return r; }
+inline vint operator>>(vint a, int n) { vint r; SIMD_PARTS(r, simd::iShr(a.p[k], n)); return r; }
+
+// Truncating conversions
+inline vint toInt(vfloat a) { vint r; SIMD_PARTS(r, simd::fToInt(a.p[k])); return r; }
+inline vfloat toFloat(vint a) { vfloat r; SIMD_PARTS(r, simd::iToFloat(a.p[k])); return r; }
+
+// base[index], lane by lane
+inline vint gather(const uint32_t *base, vint index) { vint r; SIMD_PARTS(r, simd::iGather(base, index.p[k])); return r; }
+
+// 0, 1, ..., 7
+inline vfloat laneIndex() {
+    static const float lanes[simd::WIDTH] = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f};
+    return vfloat::load(lanes);
+}
+
+// x^n for a non-negative integer n, by repeated squaring
+inline vfloat powi(vfloat x, int n) {
+    vfloat r(1.0f);
+    while (n > 0) {
+        if (n & 1)
+            r *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return r;
+}
+
+#undef SIMD_PARTS
+
+#endif //GL_TEST_SIMD_H
@@ -0,0 +1,82 @@
+//
+// Multi-threaded CPU rendering: screen tiles shaded in parallel on a
+// work-stealing pool.
+//
+
+#include "tiled_rasterizer.h"
+#include "simd.h"
+#include "../util/profiler.h"
+
+#include <algorithm>
+
+// Instances set up per task: enough work to amortise the task, small enough
+// to spread a few hundred objects over every core
+static const size_t INSTANCES_PER_CHUNK = 16;
+
+TiledRasterizer::TiledRasterizer(WorkStealingPool &pool, int tile_size) : pool(pool) {
+    // Whole lane groups per tile: neighbouring tiles never load and store
+    // the same 8 pixels
+    this->tile_size = (std::max(tile_size, 1) + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH;
+}
+
+void TiledRasterizer::render(RasterTarget &target, const RasterFrame &frame, const std::vector<RasterDrawItem> &items,
+                             uint32_t clear_color, RasterStats *stats) {
+    const int tiles_x = (target.width + tile_size - 1) / tile_size;
+    const int tiles_y = (target.height + tile_size - 1) / tile_size;
+    const size_t tile_count = (size_t) tiles_x * tiles_y;
+
+    size_t chunk_count = 0;
+    for (size_t item = 0; item < items.size(); item++) {
+        for (size_t first = 0; first < items[item].instance_count; first += INSTANCES_PER_CHUNK) {
+            if (chunk_count == chunks.size())
+                chunks.emplace_back();
+            SetupChunk &chunk = chunks[chunk_count++];
+            chunk.item = item;
+            chunk.first_instance = first;
+            chunk.instance_count = std::min(INSTANCES_PER_CHUNK, items[item].instance_count - first);
+        }
+    }
+
+    // Setup and binning
+    pool.parallelFor(chunk_count, [&](size_t task, unsigned) {
+        PROFILE_SCOPE("setup chunk");
+        SetupChunk &chunk = chunks[task];
+        const RasterDrawItem &item = items[chunk.item];
+        chunk.triangles.clear();
+        rasterSetupMesh(frame, *item.mesh, item.instances + chunk.first_instance, chunk.instance_count,
+                        item.material, target.width, target.height, chunk.triangles);
+
+        chunk.bins.resize(tile_count);
+        for (std::vector<uint32_t> &bin : chunk.bins)
+            bin.clear();
+        for (uint32_t i = 0; i < chunk.triangles.size(); i++) {
+            const RasterTriangle &tri = chunk.triangles[i];
+            for (int ty = tri.min_y / tile_size; ty <= tri.max_y / tile_size; ty++)
+                for (int tx = tri.min_x / tile_size; tx <= tri.max_x / tile_size; tx++)
+                    chunk.bins[(size_t) ty * tiles_x + tx].push_back(i);
+        }
+    });
+
+    // Rasterization, one task per tile
+    worker_stats.assign(pool.size(), RasterStats());
+    pool.parallelFor(tile_count, [&](size_t task, unsigned worker) {
+        PROFILE_SCOPE("rasterize tile");
+        int x0 = (int) (task % tiles_x) * tile_size, y0 = (int) (task / tiles_x) * tile_size;
+        int x1 = x0 + tile_size, y1 = y0 + tile_size;
+
+        rasterClearRect(target, clear_color, 1.0f, x0, y0, x1, y1);
+        for (size_t c = 0; c < chunk_count; c++) {
+            const std::vector<uint32_t> &bin = chunks[c].bins[task];
+            if (!bin.empty())
+                rasterDrawTriangles(target, frame, chunks[c].triangles.data(), bin.data(), bin.size(),
+                                    x0, y0, x1, y1, &worker_stats[worker]);
+        }
+    });
+
+    if (stats) {
+        for (const RasterStats &worker : worker_stats) {
+            stats->triangles += worker.triangles;
+            stats->fragments_shaded += worker.fragments_shaded;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+//
+// Multi-threaded CPU rendering: screen tiles shaded in parallel on a
+// work-stealing pool.
+//
+// A frame runs in two parallel phases. Setup transforms chunks of instances
+// and bins their triangles into the tiles they overlap; then each tile is
+// cleared and draws its bins, chunk by chunk. Tiles own disjoint pixels and
+// keep the submission order, so the image is identical to a serial render.
+//
+
+#ifndef GL_TEST_TILED_RASTERIZER_H
+#define GL_TEST_TILED_RASTERIZER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "rasterizer.h"
+#include "../util/work_stealing_pool.h"
+
+// Every instance of a mesh with one material
+struct RasterDrawItem {
+    const RasterMesh *mesh;
+    const InstanceData *instances;
+    size_t instance_count;
+    const RasterMaterial *material;
+};
+
+class TiledRasterizer {
+public:
+    // Tile sizes are rounded up to a multiple of the SIMD width
+    explicit TiledRasterizer(WorkStealingPool &pool, int tile_size = 64);
+
+    void render(RasterTarget &target, const RasterFrame &frame, const std::vector<RasterDrawItem> &items,
+                uint32_t clear_color, RasterStats *stats = NULL);
+
+    int tileSize() const { return tile_size; }
+
+private:
+    // Instances set up by one task, with their triangles binned per tile
+    struct SetupChunk {
+        size_t item, first_instance, instance_count;
+        std::vector<RasterTriangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+
+    WorkStealingPool &pool;
+    int tile_size;
+    std::vector<SetupChunk> chunks; // kept between frames to reuse their storage
+    std::vector<RasterStats> worker_stats;
+};
+
+#endif //GL_TEST_TILED_RASTERIZER_H
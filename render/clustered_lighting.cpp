@@ -0,0 +1,227 @@
+//
+// Clustered forward lighting: per-cluster light lists built on the CPU.
+//
+
+#include "clustered_lighting.h"
+#include "render_state.h"
+#include "uniform_blocks.h"
+#include "uniform_cache.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+bool clusteredLightingSupported() {
+    return GLEW_VERSION_3_1 || GLEW_ARB_texture_buffer_object;
+}
+
+ClusteredLighting createClusteredLighting(int tile_size, int slices) {
+    ClusteredLighting clustered;
+    clustered.tile_size = std::max(tile_size, 1);
+    clustered.slices = std::max(slices, 1);
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &clustered.max_texels);
+
+    const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+    glGenBuffers(3, clustered.buffers);
+    glGenTextures(3, clustered.textures);
+    for (int i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered.buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        bindTexture(0, GL_TEXTURE_BUFFER, clustered.textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], clustered.buffers[i]);
+    }
+    bindTexture(0, GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    clustered.clusters_ubo = createUniformBuffer(sizeof(ClustersBlock), CLUSTERS_BLOCK_BINDING);
+
+    return clustered;
+}
+
+void setClusteredLightingProgram(GLuint program) {
+    bindUniformBlock(program, "Clusters", CLUSTERS_BLOCK_BINDING);
+    useProgram(program);
+    glUniform1i(uniformLocation(program, "light_data"), LIGHT_DATA_UNIT);
+    glUniform1i(uniformLocation(program, "cluster_data"), CLUSTER_DATA_UNIT);
+    glUniform1i(uniformLocation(program, "light_indices"), LIGHT_INDICES_UNIT);
+}
+
+// View space bounds of every cluster; only needed when the viewport or the
+// projection change
+static void buildClusterBounds(ClusteredLighting &clustered) {
+    const float tan_y = tanf(0.5f * clustered.fov_y);
+    const float tan_x = tan_y * clustered.width / clustered.height;
+    const size_t count = (size_t) clustered.tiles_x * clustered.tiles_y * clustered.slices;
+    clustered.bounds_min.resize(count);
+    clustered.bounds_max.resize(count);
+
+    size_t c = 0;
+    for (int s = 0; s < clustered.slices; s++) {
+        float depths[2] = {
+            clustered.near * powf(clustered.far / clustered.near, (float) s / clustered.slices),
+            clustered.near * powf(clustered.far / clustered.near, (float) (s + 1) / clustered.slices)
+        };
+        for (int ty = 0; ty < clustered.tiles_y; ty++) {
+            for (int tx = 0; tx < clustered.tiles_x; tx++, c++) {
+                // Tile corners in NDC (tiles count from the bottom-left, as gl_FragCoord)
+                float ndc_x[2] = {2.0f * tx * clustered.tile_size / clustered.width - 1.0f,
+                                  std::min(2.0f * (tx + 1) * clustered.tile_size / clustered.width - 1.0f, 1.0f)};
+                float ndc_y[2] = {2.0f * ty * clustered.tile_size / clustered.height - 1.0f,
+                                  std::min(2.0f * (ty + 1) * clustered.tile_size / clustered.height - 1.0f, 1.0f)};
+
+                glm::vec3 lo(INFINITY, INFINITY, -depths[1]), hi(-INFINITY, -INFINITY, -depths[0]);
+                for (float depth : depths) {
+                    for (int i = 0; i < 2; i++) {
+                        lo.x = std::min(lo.x, ndc_x[i] * depth * tan_x);
+                        hi.x = std::max(hi.x, ndc_x[i] * depth * tan_x);
+                        lo.y = std::min(lo.y, ndc_y[i] * depth * tan_y);
+                        hi.y = std::max(hi.y, ndc_y[i] * depth * tan_y);
+                    }
+                }
+                clustered.bounds_min[c] = lo;
+                clustered.bounds_max[c] = hi;
+            }
+        }
+    }
+}
+
+static void uploadTextureBuffer(GLuint buffer, GLsizeiptr size, const void *data) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+}
+
+void updateClusteredLighting(ClusteredLighting &clustered, const std::vector<PointLight> &lights,
+                             const glm::mat4 &view, float fov_y, int width, int height, float near, float far) {
+    if (width != clustered.width || height != clustered.height || fov_y != clustered.fov_y ||
+        near != clustered.near || far != clustered.far) {
+        clustered.width = width;
+        clustered.height = height;
+        clustered.fov_y = fov_y;
+        clustered.near = near;
+        clustered.far = far;
+        clustered.tiles_x = (width + clustered.tile_size - 1) / clustered.tile_size;
+        clustered.tiles_y = (height + clustered.tile_size - 1) / clustered.tile_size;
+        clustered.depth_scale = clustered.slices / logf(far / near);
+        clustered.depth_bias = -logf(near) * clustered.depth_scale;
+        buildClusterBounds(clustered);
+
+        ClustersBlock grid;
+        grid.tiles = glm::ivec2(clustered.tiles_x, clustered.tiles_y);
+        grid.tile_size = clustered.tile_size;
+        grid.slices = clustered.slices;
+        grid.depth_scale_bias = glm::vec2(clustered.depth_scale, clustered.depth_bias);
+        updateUniformBuffer(clustered.clusters_ubo, sizeof(grid), &grid);
+    }
+
+    const float tan_y = tanf(0.5f * fov_y);
+    const float tan_x = tan_y * width / height;
+    const int tiles_x = clustered.tiles_x, tiles_y = clustered.tiles_y, slices = clustered.slices;
+    const size_t cluster_count = (size_t) tiles_x * tiles_y * slices;
+    auto sliceOf = [&](float depth) {
+        int s = (int) floorf(logf(depth) * clustered.depth_scale + clustered.depth_bias);
+        return std::min(std::max(s, 0), slices - 1);
+    };
+    auto tileOf = [&](float ndc, int pixels, int tiles) {
+        int t = (int) floorf((ndc * 0.5f + 0.5f) * pixels / clustered.tile_size);
+        return std::min(std::max(t, 0), tiles - 1);
+    };
+
+    clustered.counts.assign(cluster_count, 0);
+    clustered.pair_clusters.clear();
+    clustered.pair_lights.clear();
+    clustered.light_data.resize(4 * std::max(lights.size(), (size_t) 1));
+    clustered.overflowed = false;
+
+    for (size_t l = 0; l < lights.size(); l++) {
+        const PointLight &light = lights[l];
+        clustered.light_data[4 * l] = glm::vec4(light.position, light.radius);
+        clustered.light_data[4 * l + 1] = glm::vec4(light.ambient, 0.0f);
+        clustered.light_data[4 * l + 2] = glm::vec4(light.diffuse, 0.0f);
+        clustered.light_data[4 * l + 3] = glm::vec4(light.specular, 0.0f);
+
+        glm::vec3 p = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        float depth = -p.z, r = light.radius;
+        if (depth + r < near || depth - r > far)
+            continue;
+
+        int s0 = sliceOf(std::max(depth - r, near)), s1 = sliceOf(std::min(depth + r, far));
+        int tx0 = 0, tx1 = tiles_x - 1, ty0 = 0, ty1 = tiles_y - 1;
+        // Spheres reaching the near plane may cover any tile; otherwise the
+        // projection of their bounding box gives a conservative tile range
+        if (depth - r > near) {
+            float x_lo = INFINITY, x_hi = -INFINITY, y_lo = INFINITY, y_hi = -INFINITY;
+            for (float z : {depth - r, depth + r}) {
+                for (float sign : {-1.0f, 1.0f}) {
+                    float x = (p.x + sign * r) / (z * tan_x), y = (p.y + sign * r) / (z * tan_y);
+                    x_lo = std::min(x_lo, x);
+                    x_hi = std::max(x_hi, x);
+                    y_lo = std::min(y_lo, y);
+                    y_hi = std::max(y_hi, y);
+                }
+            }
+            if (x_hi < -1.0f || x_lo > 1.0f || y_hi < -1.0f || y_lo > 1.0f)
+                continue;
+            tx0 = tileOf(x_lo, width, tiles_x);
+            tx1 = tileOf(x_hi, width, tiles_x);
+            ty0 = tileOf(y_lo, height, tiles_y);
+            ty1 = tileOf(y_hi, height, tiles_y);
+        }
+
+        for (int s = s0; s <= s1; s++) {
+            for (int ty = ty0; ty <= ty1; ty++) {
+                for (int tx = tx0; tx <= tx1; tx++) {
+                    size_t c = ((size_t) s * tiles_y + ty) * tiles_x + tx;
+                    // Sphere vs cluster box
+                    glm::vec3 d = glm::max(glm::max(clustered.bounds_min[c] - p, p - clustered.bounds_max[c]),
+                                           glm::vec3(0.0f));
+                    if (glm::dot(d, d) > r * r)
+                        continue;
+                    if (clustered.pair_lights.size() >= (size_t) clustered.max_texels) {
+                        clustered.overflowed = true;
+                        continue;
+                    }
+                    clustered.pair_clusters.push_back((GLuint) c);
+                    clustered.pair_lights.push_back((GLuint) l);
+                    clustered.counts[c]++;
+                }
+            }
+        }
+    }
+
+    // Counting sort of the (cluster, light) pairs: lists stay in light order
+    clustered.cluster_data.resize(2 * cluster_count);
+    clustered.max_cluster_lights = 0;
+    GLuint offset = 0;
+    for (size_t c = 0; c < cluster_count; c++) {
+        clustered.cluster_data[2 * c] = offset;
+        clustered.cluster_data[2 * c + 1] = clustered.counts[c];
+        clustered.max_cluster_lights = std::max(clustered.max_cluster_lights, clustered.counts[c]);
+        clustered.counts[c] = offset; // becomes the fill cursor
+        offset += clustered.cluster_data[2 * c + 1];
+    }
+    clustered.light_indices.resize(std::max(clustered.pair_lights.size(), (size_t) 1));
+    for (size_t i = 0; i < clustered.pair_lights.size(); i++)
+        clustered.light_indices[clustered.counts[clustered.pair_clusters[i]]++] = clustered.pair_lights[i];
+    clustered.light_cluster_pairs = clustered.pair_lights.size();
+
+    uploadTextureBuffer(clustered.buffers[0], clustered.light_data.size() * sizeof(glm::vec4),
+                        clustered.light_data.data());
+    uploadTextureBuffer(clustered.buffers[1], clustered.cluster_data.size() * sizeof(GLuint),
+                        clustered.cluster_data.data());
+    uploadTextureBuffer(clustered.buffers[2], clustered.light_indices.size() * sizeof(GLuint),
+                        clustered.light_indices.data());
+}
+
+void bindClusteredLighting(const ClusteredLighting &clustered) {
+    const GLenum units[3] = {LIGHT_DATA_UNIT, CLUSTER_DATA_UNIT, LIGHT_INDICES_UNIT};
+    for (int i = 0; i < 3; i++)
+        bindTexture(units[i], GL_TEXTURE_BUFFER, clustered.textures[i]);
+}
+
+void destroyClusteredLighting(ClusteredLighting &clustered) {
+    renderStateForgetTextures(3, clustered.textures);
+    glDeleteTextures(3, clustered.textures);
+    glDeleteBuffers(3, clustered.buffers);
+    glDeleteBuffers(1, &clustered.clusters_ubo);
+    clustered = ClusteredLighting();
+}
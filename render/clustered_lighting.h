@@ -0,0 +1,79 @@
+//
+// Clustered forward lighting: the view frustum is split into screen tiles x
+// depth slices ("froxels") and every cluster gets the list of lights whose
+// range reaches it, so a fragment only evaluates the lights near it.
+//
+// Light lists are built on the CPU every frame and read by the clustered
+// fragment shaders through texture buffers:
+//   light_data     RGBA32F, 4 texels per light (position + radius, ambient,
+//                  diffuse, specular)
+//   cluster_data   RG32UI, per cluster: first entry in light_indices, count
+//   light_indices  R32UI, light numbers, grouped by cluster
+// and the grid layout through the Clusters uniform block.
+//
+
+#ifndef GL_TEST_CLUSTERED_LIGHTING_H
+#define GL_TEST_CLUSTERED_LIGHTING_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct PointLight {
+    glm::vec3 position;
+    float radius; // the light has no effect at or beyond this distance
+    glm::vec3 ambient, diffuse, specular;
+};
+
+// Texture units of the light buffers, after the material maps (0 and 1)
+enum ClusterTextureUnit {
+    LIGHT_DATA_UNIT = 2,
+    CLUSTER_DATA_UNIT = 3,
+    LIGHT_INDICES_UNIT = 4
+};
+
+struct ClusteredLighting {
+    GLuint buffers[3] = {0, 0, 0};  // light_data, cluster_data, light_indices
+    GLuint textures[3] = {0, 0, 0};
+    GLuint clusters_ubo = 0;
+    GLint max_texels = 0;
+
+    // Grid: tile_size pixel tiles, slices exponentially spaced in depth
+    int tile_size = 64, slices = 24;
+    int tiles_x = 0, tiles_y = 0;
+    int width = 0, height = 0;
+    float fov_y = 0.0f, near = 0.0f, far = 0.0f;
+    float depth_scale = 0.0f, depth_bias = 0.0f; // slice = log(depth) * scale + bias
+    std::vector<glm::vec3> bounds_min, bounds_max; // view space AABB of every cluster
+
+    // CPU side of the buffers, kept to reuse their storage every frame
+    std::vector<glm::vec4> light_data;
+    std::vector<GLuint> cluster_data, light_indices, counts;
+    std::vector<GLuint> pair_clusters, pair_lights;
+
+    // Last update
+    size_t light_cluster_pairs = 0;
+    GLuint max_cluster_lights = 0;
+    bool overflowed = false; // light_indices hit GL_MAX_TEXTURE_BUFFER_SIZE
+};
+
+// Texture buffer objects (OpenGL 3.1)
+bool clusteredLightingSupported();
+
+ClusteredLighting createClusteredLighting(int tile_size = 64, int slices = 24);
+
+// Points the samplers and the Clusters block of a program using the light
+// lists to the units and binding above.
+void setClusteredLightingProgram(GLuint program);
+
+// Assigns `lights` to clusters for the given camera and uploads the lists
+// (and the grid, when it changed).
+void updateClusteredLighting(ClusteredLighting &clustered, const std::vector<PointLight> &lights,
+                             const glm::mat4 &view, float fov_y, int width, int height, float near, float far);
+
+// Binds the light list buffers to their texture units.
+void bindClusteredLighting(const ClusteredLighting &clustered);
+
+void destroyClusteredLighting(ClusteredLighting &clustered);
+
+#endif //GL_TEST_CLUSTERED_LIGHTING_H
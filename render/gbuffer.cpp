@@ -0,0 +1,91 @@
+//
+// Deferred shading: G-buffer framebuffer and fullscreen lighting pass.
+//
+
+#include "gbuffer.h"
+#include "render_state.h"
+#include "uniform_cache.h"
+
+#include <stdio.h>
+
+static const char *output_names[GBUFFER_ATTACHMENT_COUNT] = {"g_position", "g_normal", "g_albedo", "g_specular"};
+
+bool gbufferSupported() {
+    return GLEW_VERSION_3_0;
+}
+
+void bindGBufferOutputs(GLuint program) {
+    for (GLuint i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+        glBindFragDataLocation(program, i, output_names[i]);
+}
+
+bool resizeGBuffer(GBuffer &gbuffer, int width, int height) {
+    if (gbuffer.fbo && gbuffer.width == width && gbuffer.height == height)
+        return true;
+    destroyGBuffer(gbuffer);
+
+    const GLenum formats[GBUFFER_ATTACHMENT_COUNT] = {GL_RGBA32F, GL_RGBA16F, GL_RGBA8, GL_RGBA8};
+    GLenum draw_buffers[GBUFFER_ATTACHMENT_COUNT];
+
+    glGenFramebuffers(1, &gbuffer.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, gbuffer.fbo);
+
+    // Read with texelFetch, one texel per pixel: no filtering or mipmaps
+    glGenTextures(GBUFFER_ATTACHMENT_COUNT, gbuffer.textures);
+    for (int i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++) {
+        bindTexture(0, GL_TEXTURE_2D, gbuffer.textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, gbuffer.textures[i], 0);
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    bindTexture(0, GL_TEXTURE_2D, 0);
+    glDrawBuffers(GBUFFER_ATTACHMENT_COUNT, draw_buffers);
+
+    glGenRenderbuffers(1, &gbuffer.depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, gbuffer.depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gbuffer.depth_rbo);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: G-buffer framebuffer incomplete (0x%x)\n", status);
+        return false;
+    }
+
+    gbuffer.width = width;
+    gbuffer.height = height;
+    return true;
+}
+
+void setGBufferSamplers(GLuint program) {
+    useProgram(program);
+    for (GLuint i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+        glUniform1i(uniformLocation(program, output_names[i]), GBUFFER_FIRST_UNIT + i);
+}
+
+void bindGBufferTextures(const GBuffer &gbuffer) {
+    for (GLuint i = 0; i < GBUFFER_ATTACHMENT_COUNT; i++)
+        bindTexture(GBUFFER_FIRST_UNIT + i, GL_TEXTURE_2D, gbuffer.textures[i]);
+}
+
+void drawFullscreenTriangle() {
+    // No attributes, but core profiles still need a vertex array bound
+    static GLuint vao = 0;
+    if (!vao)
+        glGenVertexArrays(1, &vao);
+    bindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void destroyGBuffer(GBuffer &gbuffer) {
+    if (gbuffer.fbo) {
+        glDeleteFramebuffers(1, &gbuffer.fbo);
+        renderStateForgetTextures(GBUFFER_ATTACHMENT_COUNT, gbuffer.textures);
+        glDeleteTextures(GBUFFER_ATTACHMENT_COUNT, gbuffer.textures);
+        glDeleteRenderbuffers(1, &gbuffer.depth_rbo);
+    }
+    gbuffer = GBuffer();
+}
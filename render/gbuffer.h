@@ -0,0 +1,58 @@
+//
+// Deferred shading: the geometry pass writes the surface attributes of the
+// nearest fragment into a G-buffer, a fullscreen pass then lights each pixel
+// once, however many triangles overlapped it.
+//
+// Attachments (fragment shader outputs of the geometry pass):
+//   g_position  RGBA32F, world position
+//   g_normal    RGBA16F, world normal (half floats: sharp highlights can
+//               differ from forward shading by a few levels)
+//   g_albedo    RGBA8, diffuse map; alpha is 1 where geometry was drawn
+//   g_specular  RGBA8, specular map
+//
+
+#ifndef GL_TEST_GBUFFER_H
+#define GL_TEST_GBUFFER_H
+
+#include <GL/glew.h>
+
+enum GBufferAttachment {
+    GBUFFER_POSITION,
+    GBUFFER_NORMAL,
+    GBUFFER_ALBEDO,
+    GBUFFER_SPECULAR,
+    GBUFFER_ATTACHMENT_COUNT
+};
+
+// Texture units of the G-buffer in the lighting pass, after the light
+// buffers of clustered lighting (2-4)
+const GLuint GBUFFER_FIRST_UNIT = 5;
+
+struct GBuffer {
+    GLuint fbo = 0;
+    GLuint textures[GBUFFER_ATTACHMENT_COUNT] = {0, 0, 0, 0};
+    GLuint depth_rbo = 0;
+    int width = 0, height = 0;
+};
+
+// Multiple render targets and float textures (OpenGL 3.0)
+bool gbufferSupported();
+
+// Fixed fragment output locations of the geometry pass, applied before
+// linking like the attribute locations
+void bindGBufferOutputs(GLuint program);
+
+// Creates the framebuffer, or recreates it when the size changed.
+bool resizeGBuffer(GBuffer &gbuffer, int width, int height);
+
+// Points the lighting program's g_* samplers to their units.
+void setGBufferSamplers(GLuint program);
+
+void bindGBufferTextures(const GBuffer &gbuffer);
+
+// Draws a triangle covering the viewport, positions made from gl_VertexID.
+void drawFullscreenTriangle();
+
+void destroyGBuffer(GBuffer &gbuffer);
+
+#endif //GL_TEST_GBUFFER_H
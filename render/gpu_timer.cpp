@@ -0,0 +1,103 @@
+//
+// GPU time of every render pass, read back a few frames late.
+//
+
+#include "gpu_timer.h"
+
+#include <algorithm>
+
+GpuPassTimer::GpuPassTimer(unsigned latency) : frames(std::max(latency, 1u)) {
+}
+
+GpuPassTimer::~GpuPassTimer() {
+    for (Frame &frame : frames) {
+        if (!frame.queries.empty())
+            glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+    }
+}
+
+bool GpuPassTimer::supported() {
+    return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+void GpuPassTimer::beginFrame() {
+    // The slot's previous frame was issued `latency` frames ago
+    Frame &frame = frames[current];
+    if (frame.pending)
+        collect(frame, false);
+
+    frame.used = 0;
+    frame.names.clear();
+    recording = true;
+}
+
+void GpuPassTimer::stamp(Frame &frame) {
+    if (frame.used == frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    glQueryCounter(frame.queries[frame.used++], GL_TIMESTAMP);
+}
+
+void GpuPassTimer::beginPass(const char *name) {
+    if (!recording)
+        return;
+    Frame &frame = frames[current];
+    stamp(frame);
+    frame.names.push_back(name);
+}
+
+void GpuPassTimer::endFrame() {
+    if (!recording)
+        return;
+    Frame &frame = frames[current];
+    if (frame.used > 0) {
+        stamp(frame);
+        frame.pending = true;
+    }
+    recording = false;
+    current = (current + 1) % frames.size();
+}
+
+void GpuPassTimer::finish() {
+    // Oldest first, so samples stay in frame order
+    for (size_t i = 0; i < frames.size(); i++) {
+        Frame &frame = frames[(current + i) % frames.size()];
+        if (frame.pending)
+            collect(frame, true);
+    }
+}
+
+void GpuPassTimer::collect(Frame &frame, bool wait) {
+    frame.pending = false;
+
+    // Queries complete in order: the last one being available means all are
+    GLuint available = GL_TRUE;
+    if (!wait)
+        glGetQueryObjectuiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        dropped++;
+        return;
+    }
+
+    GLuint64 first = 0;
+    glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &first);
+    GLuint64 previous = first;
+    for (size_t i = 1; i < frame.used; i++) {
+        GLuint64 timestamp = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamp);
+
+        const char *name = frame.names[i - 1];
+        auto pass = std::find_if(pass_times.begin(), pass_times.end(),
+                                 [name](const GpuPassTimes &times) { return times.name == name; });
+        if (pass == pass_times.end()) {
+            pass_times.push_back(GpuPassTimes());
+            pass_times.back().name = name;
+            pass = pass_times.end() - 1;
+        }
+        pass->ms.push_back((timestamp - previous) * 1e-6);
+        previous = timestamp;
+    }
+    frame_ms.push_back((previous - first) * 1e-6);
+}
@@ -0,0 +1,66 @@
+//
+// GPU time of every render pass: a GL_TIMESTAMP query at each pass boundary,
+// from a ring of per-frame query sets. A frame's timestamps are read back
+// when its slot comes round again, `latency` frames later, by which time the
+// GPU has finished them, so the CPU never waits on a result. A frame whose
+// queries are still not available is dropped rather than waited for.
+//
+
+#ifndef GL_TEST_GPU_TIMER_H
+#define GL_TEST_GPU_TIMER_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+struct GpuPassTimes {
+    std::string name;
+    std::vector<double> ms; // one sample per frame read back
+};
+
+class GpuPassTimer {
+public:
+    explicit GpuPassTimer(unsigned latency = 3);
+    ~GpuPassTimer();
+
+    GpuPassTimer(const GpuPassTimer &) = delete;
+    GpuPassTimer &operator=(const GpuPassTimer &) = delete;
+
+    // Timestamp queries (OpenGL 3.3)
+    static bool supported();
+
+    // Brackets a frame; each pass lasts from its beginPass() to the next one
+    // or to endFrame(). `name` must outlive the timer (a string literal).
+    void beginFrame();
+    void beginPass(const char *name);
+    void endFrame();
+
+    // Reads the frames still in flight, waiting for them (end of a run)
+    void finish();
+
+    // Passes in order of first appearance
+    const std::vector<GpuPassTimes> &passes() const { return pass_times; }
+    // Whole frames read back, from their first timestamp to their last
+    const std::vector<double> &frameTimes() const { return frame_ms; }
+    size_t droppedFrames() const { return dropped; }
+
+private:
+    struct Frame {
+        std::vector<GLuint> queries;     // grown as passes are added
+        std::vector<const char *> names; // pass starting at each timestamp but the last
+        size_t used = 0;
+        bool pending = false;
+    };
+
+    void stamp(Frame &frame);
+    void collect(Frame &frame, bool wait);
+
+    std::vector<Frame> frames;
+    size_t current = 0;
+    bool recording = false;
+    std::vector<GpuPassTimes> pass_times;
+    std::vector<double> frame_ms;
+    size_t dropped = 0;
+};
+
+#endif //GL_TEST_GPU_TIMER_H
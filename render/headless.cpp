@@ -0,0 +1,130 @@
+//
+// Headless (window-less) rendering through an EGL surfaceless context.
+//
+
+#include "headless.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <vector>
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+static GLuint fbo = 0;
+static GLuint color_rbo = 0, depth_rbo = 0;
+
+bool headlessCreateContext() {
+    // Prefer Mesa's surfaceless platform: no X11/Wayland/DRM device needed
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        egl_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (egl_display == EGL_NO_DISPLAY)
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (egl_display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "ERROR: could not get an EGL display\n");
+        return false;
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(egl_display, &major, &minor)) {
+        fprintf(stderr, "ERROR: could not initialise EGL (0x%x)\n", eglGetError());
+        return false;
+    }
+    printf("EGL version %d.%d (%s)\n", major, minor, eglQueryString(egl_display, EGL_VENDOR));
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "ERROR: EGL display does not support desktop OpenGL\n");
+        return false;
+    }
+
+    // The surfaceless platform exposes no configs: fall back to
+    // EGL_KHR_no_config_context, which is what it expects anyway.
+    const EGLint config_attribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+    };
+    EGLConfig config = NULL;
+    EGLint num_configs = 0;
+    eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs);
+    if (num_configs == 0)
+        config = NULL;
+
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, NULL);
+    if (egl_context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "ERROR: could not create EGL context (0x%x)\n", eglGetError());
+        return false;
+    }
+    if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+        fprintf(stderr, "ERROR: could not make EGL context current (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+bool headlessCreateFramebuffer(int width, int height) {
+    glGenRenderbuffers(1, &color_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "ERROR: offscreen framebuffer incomplete (0x%x)\n", status);
+        return false;
+    }
+
+    return true;
+}
+
+bool headlessWritePPM(const char *path, int width, int height) {
+    std::vector<unsigned char> pixels((size_t) width * height * 3);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    // OpenGL rows go bottom-up, PPM rows top-down
+    for (int y = height - 1; y >= 0; y--)
+        fwrite(&pixels[(size_t) y * width * 3], 1, (size_t) width * 3, fp);
+    fclose(fp);
+
+    return true;
+}
+
+GLuint headlessFramebuffer() {
+    return fbo;
+}
+
+void headlessTerminate() {
+    if (fbo) {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color_rbo);
+        glDeleteRenderbuffers(1, &depth_rbo);
+        fbo = color_rbo = depth_rbo = 0;
+    }
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (egl_context != EGL_NO_CONTEXT)
+            eglDestroyContext(egl_display, egl_context);
+        eglTerminate(egl_display);
+        egl_display = EGL_NO_DISPLAY;
+        egl_context = EGL_NO_CONTEXT;
+    }
+}
@@ -0,0 +1,25 @@
+//
+// Headless (window-less) rendering through an EGL surfaceless context.
+//
+
+#ifndef GL_TEST_HEADLESS_H
+#define GL_TEST_HEADLESS_H
+
+#include <GL/glew.h>
+
+// Creates an EGL surfaceless OpenGL context and makes it current. Must be
+// called before glewInit(). Works on Mesa (llvmpipe) without a display server.
+bool headlessCreateContext();
+
+// Creates the offscreen framebuffer (RGBA8 color + 24-bit depth) that replaces
+// the window's default framebuffer and leaves it bound. Needs GLEW initialised.
+bool headlessCreateFramebuffer(int width, int height);
+
+// Reads back the color attachment and stores it as a binary PPM (P6) image.
+bool headlessWritePPM(const char *path, int width, int height);
+
+GLuint headlessFramebuffer();
+
+void headlessTerminate();
+
+#endif //GL_TEST_HEADLESS_H
@@ -0,0 +1,118 @@
+//
+// Hardware instancing: per-instance transforms streamed through a vertex
+// buffer so every copy of a mesh is drawn with a single call.
+//
+
+#include "instancing.h"
+#include "render_state.h"
+
+#include <stddef.h>
+
+void bindInstanceAttributes(GLuint program) {
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL, "i_model");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_NORMAL, "i_normal_to_world");
+}
+
+bool instancingSupported() {
+    // glDrawElementsInstanced (3.1) and glVertexAttribDivisor (3.3)
+    return GLEW_VERSION_3_3 || (GLEW_ARB_draw_instanced && GLEW_ARB_instanced_arrays);
+}
+
+// Instance attributes of `mesh`'s VAO, read from `vbo`
+static void setInstanceAttributes(const Mesh &mesh, GLuint vbo) {
+    bindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    // Matrices take one attribute location per column
+    for (int column = 0; column < 4; column++) {
+        GLuint location = ATTRIB_INSTANCE_MODEL + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (const void *) (offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+    for (int column = 0; column < 3; column++) {
+        GLuint location = ATTRIB_INSTANCE_NORMAL + column;
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (const void *) (offsetof(InstanceData, normal_to_world) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    bindVertexArray(0);
+}
+
+InstanceBuffer createInstanceBuffer(const Mesh &mesh, GLsizei capacity) {
+    InstanceBuffer buffer;
+    buffer.capacity = capacity > 0 ? capacity : 1;
+
+    glGenBuffers(1, &buffer.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.vbo);
+    glBufferData(GL_ARRAY_BUFFER, buffer.capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    setInstanceAttributes(mesh, buffer.vbo);
+
+    return buffer;
+}
+
+InstanceBuffer createStreamedInstanceBuffer(const Mesh &mesh, const RingBuffer &ring) {
+    InstanceBuffer buffer;
+    buffer.vbo = ring.buffer();
+    buffer.streamed = true;
+    setInstanceAttributes(mesh, buffer.vbo);
+
+    return buffer;
+}
+
+InstanceData *streamInstances(InstanceBuffer &buffer, RingBuffer &ring, GLsizei count) {
+    // Aligned to whole instances, so the offset is a base instance
+    GLintptr offset = 0;
+    void *instances = ring.allocate(count * sizeof(InstanceData), sizeof(InstanceData), offset);
+    buffer.count = instances ? count : 0;
+    buffer.first = (GLuint) (offset / sizeof(InstanceData));
+
+    return (InstanceData *) instances;
+}
+
+void updateInstanceBuffer(InstanceBuffer &buffer, const InstanceData *instances, GLsizei count) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.vbo);
+    if (count > buffer.capacity)
+        buffer.capacity = count;
+    glBufferData(GL_ARRAY_BUFFER, buffer.capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+    buffer.count = count;
+}
+
+void updateInstanceBuffer(InstanceBuffer &buffer, const std::vector<const std::vector<InstanceData> *> &ranges) {
+    GLsizei count = 0;
+    for (const std::vector<InstanceData> *range : ranges)
+        count += (GLsizei) range->size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.vbo);
+    if (count > buffer.capacity)
+        buffer.capacity = count;
+    glBufferData(GL_ARRAY_BUFFER, buffer.capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    GLintptr offset = 0;
+    for (const std::vector<InstanceData> *range : ranges) {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, range->size() * sizeof(InstanceData), range->data());
+        offset += range->size() * sizeof(InstanceData);
+    }
+    buffer.count = count;
+}
+
+void drawMeshInstanced(const Mesh &mesh, const InstanceBuffer &instances) {
+    if (instances.count == 0)
+        return;
+
+    bindVertexArray(mesh.vao);
+    if (instances.first)
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, mesh.index_count, GL_UNSIGNED_SHORT, NULL, instances.count,
+                                            instances.first);
+    else
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.index_count, GL_UNSIGNED_SHORT, NULL, instances.count);
+}
+
+void destroyInstanceBuffer(InstanceBuffer &buffer) {
+    if (buffer.vbo && !buffer.streamed)
+        glDeleteBuffers(1, &buffer.vbo);
+    buffer = InstanceBuffer();
+}
@@ -0,0 +1,68 @@
+//
+// Hardware instancing: per-instance transforms streamed through a vertex
+// buffer so every copy of a mesh is drawn with a single call.
+//
+
+#ifndef GL_TEST_INSTANCING_H
+#define GL_TEST_INSTANCING_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+#include "ring_buffer.h"
+
+// Per-instance vertex attributes (divisor 1), after the per-vertex ones
+enum InstanceAttribute {
+    ATTRIB_INSTANCE_MODEL = 3,  // i_model, mat4: locations 3-6
+    ATTRIB_INSTANCE_NORMAL = 7  // i_normal_to_world, mat3: locations 7-9
+};
+
+void bindInstanceAttributes(GLuint program);
+
+// The normal matrix is precomputed on the CPU, once per instance per frame,
+// rather than inverted for every vertex.
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normal_to_world;
+};
+
+struct InstanceBuffer {
+    GLuint vbo = 0;
+    GLsizei capacity = 0; // instances the buffer storage can hold
+    GLsizei count = 0;    // instances uploaded by the last update
+    GLuint first = 0;     // base instance of the draws: where those start
+    bool streamed = false; // `vbo` is a ring buffer's, not the instance buffer's
+};
+
+bool instancingSupported();
+
+// Creates the instance buffer and records its attributes in `mesh`'s VAO.
+InstanceBuffer createInstanceBuffer(const Mesh &mesh, GLsizei capacity);
+
+// Records instance attributes read from `ring`'s buffer in `mesh`'s VAO.
+// Every frame streamInstances() hands out room for the instances in the
+// ring's current region and the draws find them through their base
+// instance, so the VAO never changes.
+InstanceBuffer createStreamedInstanceBuffer(const Mesh &mesh, const RingBuffer &ring);
+
+// Room for this frame's `count` instances of a streamed buffer, for the CPU
+// to write in place; NULL (and nothing to draw) when the ring is full.
+InstanceData *streamInstances(InstanceBuffer &buffer, RingBuffer &ring, GLsizei count);
+
+// Uploads `count` instances, growing the storage when needed. The previous
+// storage is orphaned so the upload never waits for in-flight draws.
+void updateInstanceBuffer(InstanceBuffer &buffer, const InstanceData *instances, GLsizei count);
+
+// Same for the instances of several draws, back to back: the draw of
+// ranges[i] starts after the instances of the ones before (its base instance).
+void updateInstanceBuffer(InstanceBuffer &buffer, const std::vector<const std::vector<InstanceData> *> &ranges);
+
+// One glDrawElementsInstanced call for every instance in `instances`
+// (glDrawElementsInstancedBaseInstance, OpenGL 4.2, from a ring buffer).
+void drawMeshInstanced(const Mesh &mesh, const InstanceBuffer &instances);
+
+void destroyInstanceBuffer(InstanceBuffer &buffer);
+
+#endif //GL_TEST_INSTANCING_H
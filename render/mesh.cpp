@@ -0,0 +1,104 @@
+//
+// GPU meshes: vertex format, buffer layout and indexed draw.
+//
+
+#include "mesh.h"
+#include "render_state.h"
+
+#include <stddef.h>
+
+void bindVertexAttributes(GLuint program) {
+    glBindAttribLocation(program, ATTRIB_POSITION, "v_pos");
+    glBindAttribLocation(program, ATTRIB_NORMAL, "v_normal");
+    glBindAttribLocation(program, ATTRIB_TEXCOORD, "v_tex");
+}
+
+const char *vertexLayoutName(VertexLayout layout) {
+    return layout == VERTEX_LAYOUT_INTERLEAVED ? "interleaved" : "separate";
+}
+
+std::vector<Vertex> interleaveVertices(const GLfloat *positions, const GLfloat *normals,
+                                       const GLfloat *uvs, int vertex_count) {
+    std::vector<Vertex> vertices(vertex_count);
+    for (int i = 0; i < vertex_count; i++) {
+        Vertex &vertex = vertices[i];
+        for (int c = 0; c < 3; c++) {
+            vertex.position[c] = positions[i * 3 + c];
+            vertex.normal[c] = normals[i * 3 + c];
+        }
+        vertex.uv[0] = uvs[i * 2];
+        vertex.uv[1] = uvs[i * 2 + 1];
+    }
+
+    return vertices;
+}
+
+static GLuint createArrayBuffer(GLsizeiptr size, const void *data) {
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+
+    return buffer;
+}
+
+Mesh createMesh(const GLfloat *positions, const GLfloat *normals, const GLfloat *uvs, int vertex_count,
+                const GLushort *indices, int index_count, VertexLayout layout) {
+    Mesh mesh;
+    mesh.vertex_count = vertex_count;
+    mesh.index_count = index_count;
+    mesh.layout = layout;
+
+    glGenVertexArrays(1, &mesh.vao);
+    bindVertexArray(mesh.vao);
+
+    if (layout == VERTEX_LAYOUT_INTERLEAVED) {
+        std::vector<Vertex> vertices = interleaveVertices(positions, normals, uvs, vertex_count);
+        mesh.vbo[0] = createArrayBuffer(vertices.size() * sizeof(Vertex), vertices.data());
+
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (const void *) offsetof(Vertex, position));
+        glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (const void *) offsetof(Vertex, normal));
+        glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (const void *) offsetof(Vertex, uv));
+    } else {
+        mesh.vbo[0] = createArrayBuffer(vertex_count * 3 * sizeof(GLfloat), positions);
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+        mesh.vbo[1] = createArrayBuffer(vertex_count * 3 * sizeof(GLfloat), normals);
+        glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+        mesh.vbo[2] = createArrayBuffer(vertex_count * 2 * sizeof(GLfloat), uvs);
+        glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    }
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glEnableVertexAttribArray(ATTRIB_NORMAL);
+    glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+
+    // Element Buffer Object (16-bit triangle indices, recorded in the vao)
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(GLushort), indices, GL_STATIC_DRAW);
+
+    bindVertexArray(0);
+
+    return mesh;
+}
+
+void drawMesh(const Mesh &mesh) {
+    bindVertexArray(mesh.vao);
+    glDrawElements(GL_TRIANGLES, mesh.index_count, GL_UNSIGNED_SHORT, NULL);
+}
+
+void destroyMesh(Mesh &mesh) {
+    renderStateForgetVertexArray(mesh.vao);
+    glDeleteVertexArrays(1, &mesh.vao);
+    for (GLuint &vbo : mesh.vbo) {
+        if (vbo)
+            glDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    glDeleteBuffers(1, &mesh.ebo);
+    mesh.vao = mesh.ebo = 0;
+}
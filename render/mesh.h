@@ -0,0 +1,60 @@
+//
+// GPU meshes: vertex format, buffer layout and indexed draw.
+//
+
+#ifndef GL_TEST_MESH_H
+#define GL_TEST_MESH_H
+
+#include <GL/glew.h>
+#include <vector>
+
+// Attribute locations, bound explicitly before linking every program
+enum VertexAttribute {
+    ATTRIB_POSITION = 0, // v_pos
+    ATTRIB_NORMAL = 1,   // v_normal
+    ATTRIB_TEXCOORD = 2  // v_tex
+};
+
+void bindVertexAttributes(GLuint program);
+
+// Interleaved vertex: one 32-byte record per vertex, so fetching a vertex
+// touches a single cache line instead of one per attribute stream.
+struct Vertex {
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat uv[2];
+};
+
+static_assert(sizeof(Vertex) == 32, "Vertex must be tightly packed");
+
+enum VertexLayout {
+    VERTEX_LAYOUT_INTERLEAVED, // single VBO of Vertex records (default)
+    VERTEX_LAYOUT_SEPARATE     // one VBO per attribute, kept for comparison
+};
+
+const char *vertexLayoutName(VertexLayout layout);
+
+struct Mesh {
+    GLuint vao = 0;
+    GLuint vbo[3] = {0, 0, 0}; // only vbo[0] is used by the interleaved layout
+    GLuint ebo = 0;
+    GLsizei vertex_count = 0;
+    GLsizei index_count = 0;
+    VertexLayout layout = VERTEX_LAYOUT_INTERLEAVED;
+};
+
+// Packs separate position (xyz), normal (xyz) and uv arrays into vertices.
+std::vector<Vertex> interleaveVertices(const GLfloat *positions, const GLfloat *normals,
+                                       const GLfloat *uvs, int vertex_count);
+
+// Uploads the geometry with the requested layout plus a 16-bit index buffer,
+// all recorded in a new vertex array object.
+Mesh createMesh(const GLfloat *positions, const GLfloat *normals, const GLfloat *uvs, int vertex_count,
+                const GLushort *indices, int index_count, VertexLayout layout);
+
+// Binds the mesh vertex array and draws all its triangles.
+void drawMesh(const Mesh &mesh);
+
+void destroyMesh(Mesh &mesh);
+
+#endif //GL_TEST_MESH_H
@@ -0,0 +1,38 @@
+//
+// Mesh pool: many meshes in shared vertex and index buffers.
+//
+
+#include "mesh_pool.h"
+
+uint32_t MeshPool::add(const GLfloat *mesh_positions, const GLfloat *mesh_normals, const GLfloat *mesh_uvs,
+                       int vertex_count, const GLushort *mesh_indices, int index_count) {
+    PooledMesh mesh;
+    mesh.first_index = (GLuint) indices.size();
+    mesh.index_count = index_count;
+    mesh.base_vertex = (GLint) (positions.size() / 3);
+    meshes.push_back(mesh);
+
+    positions.insert(positions.end(), mesh_positions, mesh_positions + vertex_count * 3);
+    normals.insert(normals.end(), mesh_normals, mesh_normals + vertex_count * 3);
+    uvs.insert(uvs.end(), mesh_uvs, mesh_uvs + vertex_count * 2);
+    indices.insert(indices.end(), mesh_indices, mesh_indices + index_count);
+
+    return (uint32_t) meshes.size() - 1;
+}
+
+void MeshPool::upload(VertexLayout layout) {
+    if (pool.vao)
+        destroyMesh(pool);
+    pool = createMesh(positions.data(), normals.data(), uvs.data(), (int) (positions.size() / 3), indices.data(),
+                      (int) indices.size(), layout);
+}
+
+void MeshPool::destroy() {
+    if (pool.vao)
+        destroyMesh(pool);
+    positions.clear();
+    normals.clear();
+    uvs.clear();
+    indices.clear();
+    meshes.clear();
+}
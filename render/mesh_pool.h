@@ -0,0 +1,47 @@
+//
+// Mesh pool: the geometry of several meshes sub-allocated from one set of
+// vertex buffers and one index buffer behind a single vertex array, so draws
+// of different meshes need no rebinding and can share one multi-draw call
+// (multi_draw.h). Each mesh is a range of indices plus the base vertex they
+// are relative to.
+//
+
+#ifndef GL_TEST_MESH_POOL_H
+#define GL_TEST_MESH_POOL_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "mesh.h"
+
+struct PooledMesh {
+    GLuint first_index = 0;
+    GLsizei index_count = 0;
+    GLint base_vertex = 0;
+};
+
+class MeshPool {
+public:
+    // Queues a mesh for upload() (its 16-bit indices count from its own first
+    // vertex), returning its index
+    uint32_t add(const GLfloat *positions, const GLfloat *normals, const GLfloat *uvs, int vertex_count,
+                 const GLushort *indices, int index_count);
+    // Uploads every mesh added so far into the pool's buffers
+    void upload(VertexLayout layout);
+    void destroy();
+
+    // Vertex array and buffers of the whole pool
+    const Mesh &geometry() const { return pool; }
+    const PooledMesh &operator[](uint32_t mesh) const { return meshes[mesh]; }
+    size_t size() const { return meshes.size(); }
+
+private:
+    std::vector<GLfloat> positions, normals, uvs;
+    std::vector<GLushort> indices;
+    std::vector<PooledMesh> meshes;
+    Mesh pool;
+};
+
+#endif //GL_TEST_MESH_POOL_H
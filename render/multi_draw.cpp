@@ -0,0 +1,72 @@
+//
+// Multi-draw indirect submission of pooled meshes.
+//
+
+#include "multi_draw.h"
+#include "render_state.h"
+
+#include <stddef.h>
+#include <string.h>
+
+bool multiDrawSupported() {
+    return (GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance)) &&
+           GLEW_ARB_shader_draw_parameters;
+}
+
+void MultiDraw::create(RingBuffer *ring_buffer) {
+    ring = ring_buffer;
+    glGenBuffers(1, &indirect_buffer);
+    draws_ubo = createUniformBuffer(sizeof(DrawsBlock), DRAWS_BLOCK_BINDING);
+    draws = DrawsBlock();
+}
+
+void MultiDraw::destroy() {
+    if (indirect_buffer)
+        glDeleteBuffers(1, &indirect_buffer);
+    if (draws_ubo)
+        glDeleteBuffers(1, &draws_ubo);
+    indirect_buffer = draws_ubo = 0;
+}
+
+void MultiDraw::draw(const RenderQueue &queue, size_t first, size_t end) {
+    // Commands and per-draw data line up, so gl_DrawIDARB finds the layers
+    commands.clear();
+    for (size_t i = first; i < end; i++) {
+        const DrawItem &item = queue[i];
+        if (item.instance_count == 0)
+            continue;
+
+        DrawElementsIndirectCommand command;
+        command.count = (GLuint) item.pooled->index_count;
+        command.instance_count = (GLuint) item.instance_count;
+        command.first_index = item.pooled->first_index;
+        command.base_vertex = item.pooled->base_vertex;
+        command.base_instance = item.instances->first + item.first_instance;
+        draws.draws[commands.size()].diffuse_layer = item.layers[0];
+        draws.draws[commands.size()].specular_layer = item.layers[1];
+        commands.push_back(command);
+    }
+    if (commands.empty())
+        return;
+
+    const DrawItem &batch = queue[first];
+    useProgram(batch.program);
+    for (GLuint unit = 0; unit < 2; unit++) {
+        if (batch.textures[unit])
+            bindTexture(unit, batch.texture_target, batch.textures[unit]);
+    }
+    bindVertexArray(batch.mesh->vao);
+
+    streamUniformBlock(ring, draws_ubo, DRAWS_BLOCK_BINDING, &draws, sizeof(DrawsBlock));
+    GLsizeiptr size = commands.size() * sizeof(DrawElementsIndirectCommand);
+    GLintptr offset = 0;
+    void *dst = ring ? ring->allocate(size, sizeof(GLuint), offset) : NULL;
+    if (dst) {
+        memcpy(dst, commands.data(), size);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer());
+    } else {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, size, commands.data(), GL_STREAM_DRAW);
+    }
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (const void *) offset, (GLsizei) commands.size(), 0);
+}
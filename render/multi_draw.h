@@ -0,0 +1,52 @@
+//
+// Multi-draw indirect: runs of queued draws of pooled meshes (mesh_pool.h)
+// that share a program and textures go out as one
+// glMultiDrawElementsIndirect call. Each command selects its mesh through
+// its first index and base vertex and its instances through its base
+// instance; the shaders (MULTI_DRAW variants) find the draw's texture array
+// layers in the Draws uniform block at gl_DrawIDARB.
+//
+// Given a ring buffer (ring_buffer.h), the commands and the Draws block are
+// written into it; otherwise they go to buffers of their own, orphaned at
+// every draw().
+//
+
+#ifndef GL_TEST_MULTI_DRAW_H
+#define GL_TEST_MULTI_DRAW_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "uniform_blocks.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Indirect multi-draws with base instances (OpenGL 4.3) and gl_DrawIDARB
+bool multiDrawSupported();
+
+class MultiDraw {
+public:
+    void create(RingBuffer *ring = NULL);
+    void destroy();
+
+    // One call for the queue's items [first, end), a RenderQueue::batchEnd() run
+    void draw(const RenderQueue &queue, size_t first, size_t end);
+
+private:
+    RingBuffer *ring = NULL;
+    GLuint indirect_buffer = 0;
+    GLuint draws_ubo = 0;
+    std::vector<DrawElementsIndirectCommand> commands;
+    DrawsBlock draws;
+};
+
+#endif //GL_TEST_MULTI_DRAW_H
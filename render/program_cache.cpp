@@ -0,0 +1,145 @@
+//
+// On-disk cache of linked program binaries (glGetProgramBinary).
+//
+
+#include "program_cache.h"
+#include "../util/hash.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const char PROGRAM_CACHE_MAGIC[4] = {'P', 'B', 'I', 'N'};
+// Bump when attribute or block bindings applied before linking change: they
+// are baked into the binary but not into the key
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// File layout: header, then `length` bytes of binary in `format`
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static std::string cacheFilePath(const char *cache_dir, uint64_t key) {
+    return std::string(cache_dir) + "/" + hashToHex(key) + ".pbin";
+}
+
+bool programBinarySupported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+uint64_t programCacheKey(const char *const *sources, int count) {
+    uint64_t hash = fnv1a64(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+
+    const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for (GLenum name : strings) {
+        const char *value = (const char *) glGetString(name);
+        // Include the terminator so adjacent strings cannot run together
+        if (value)
+            hash = fnv1a64(value, strlen(value) + 1, hash);
+    }
+    for (int i = 0; i < count; i++)
+        hash = fnv1a64(sources[i], strlen(sources[i]) + 1, hash);
+
+    return hash;
+}
+
+GLuint programCacheLoad(const char *cache_dir, uint64_t key) {
+    std::string file = cacheFilePath(cache_dir, key);
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+        return 0;
+
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1 &&
+                 memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) == 0 &&
+                 header.version == PROGRAM_CACHE_VERSION &&
+                 header.key == key && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+    }
+    fclose(fp);
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    // Rejected by the driver or truncated: the caller recompiles and rewrites it
+    if (!program)
+        unlink(file.c_str());
+
+    return program;
+}
+
+bool programCacheStore(const char *cache_dir, uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return false;
+    header.format = format;
+    header.length = (uint32_t) written;
+
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "WARNING: could not create shader cache directory %s\n", cache_dir);
+        return false;
+    }
+
+    // Write to a temporary name and rename: readers never see partial files
+    std::string file = cacheFilePath(cache_dir, key);
+    std::string temporary = file + ".tmp" + std::to_string(getpid());
+    FILE *fp = fopen(temporary.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "WARNING: could not write shader cache file %s\n", temporary.c_str());
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(binary.data(), 1, written, fp);
+
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+        ok = rename(temporary.c_str(), file.c_str()) == 0;
+    if (!ok) {
+        fprintf(stderr, "WARNING: could not write shader cache file %s\n", file.c_str());
+        unlink(temporary.c_str());
+    }
+
+    return ok;
+}
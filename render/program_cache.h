@@ -0,0 +1,29 @@
+//
+// On-disk cache of linked program binaries (glGetProgramBinary).
+//
+// Binaries are only valid for the driver that produced them, so the key
+// covers the shader sources and the vendor, renderer and version strings:
+// a driver update or a shader edit simply misses and recompiles.
+//
+
+#ifndef GL_TEST_PROGRAM_CACHE_H
+#define GL_TEST_PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+// OpenGL 4.1 or ARB_get_program_binary, with at least one binary format
+bool programBinarySupported();
+
+// Hash of the sources and of the current context's driver strings.
+uint64_t programCacheKey(const char *const *sources, int count);
+
+// Creates a program from the cached binary for `key`; 0 when there is none
+// or the driver rejects it (the stale entry is then removed).
+GLuint programCacheLoad(const char *cache_dir, uint64_t key);
+
+// Saves the binary of a linked program, which should have been linked with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+bool programCacheStore(const char *cache_dir, uint64_t key, GLuint program);
+
+#endif //GL_TEST_PROGRAM_CACHE_H
@@ -0,0 +1,106 @@
+//
+// Render queue: draws radix sorted by state and depth.
+//
+
+#include "render_queue.h"
+#include "render_state.h"
+#include "uniform_blocks.h"
+
+#include <string.h>
+#include <utility>
+
+static const int ID_BITS = 12;
+static const int DEPTH_BITS = 28;
+
+// Small id of `state`, assigned on first sight; the last id is shared once
+// they run out (keys then group those states less well, draws stay right)
+static uint64_t stateId(std::vector<uint64_t> &ids, uint64_t state) {
+    for (size_t id = 0; id < ids.size(); id++) {
+        if (ids[id] == state)
+            return id;
+    }
+    if (ids.size() < (1u << ID_BITS) - 1)
+        ids.push_back(state);
+    return ids.size() - 1;
+}
+
+void drawItem(const DrawItem &item) {
+    useProgram(item.program);
+    for (GLuint unit = 0; unit < 2; unit++) {
+        if (item.textures[unit])
+            bindTexture(unit, item.texture_target, item.textures[unit]);
+    }
+    drawMeshInstanced(*item.mesh, *item.instances);
+}
+
+void RenderQueue::clear() {
+    items.clear();
+    keys.clear();
+    order.clear();
+}
+
+uint64_t RenderQueue::sortKey(const DrawItem &item, float depth) {
+    uint64_t program = stateId(program_ids, item.program);
+    uint64_t texture_set = stateId(texture_set_ids, (uint64_t) item.textures[0] << 32 | item.textures[1]);
+    uint64_t vao = stateId(vao_ids, item.mesh->vao);
+
+    // Non-negative floats order like their bits: keep the top ones
+    uint32_t depth_bits = 0;
+    if (depth > 0.0f)
+        memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    depth_bits >>= 31 - DEPTH_BITS;
+
+    return program << (64 - ID_BITS) | texture_set << (64 - 2 * ID_BITS) | vao << DEPTH_BITS | depth_bits;
+}
+
+void RenderQueue::add(const DrawItem &item, float depth) {
+    order.push_back((uint32_t) items.size());
+    keys.push_back(sortKey(item, depth));
+    items.push_back(item);
+}
+
+void RenderQueue::sort() {
+    // Least significant byte first, stable, so equal keys keep queue order.
+    // Bytes every key shares (most of the id bits, with few states) are
+    // skipped.
+    const size_t count = keys.size();
+    key_scratch.resize(count);
+    order_scratch.resize(count);
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = {};
+        for (size_t i = 0; i < count; i++)
+            offsets[(keys[i] >> shift) & 0xff]++;
+        if (count == 0 || offsets[(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        size_t sum = 0;
+        for (size_t &offset : offsets) {
+            size_t digits = offset;
+            offset = sum;
+            sum += digits;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = offsets[(keys[i] >> shift) & 0xff]++;
+            key_scratch[slot] = keys[i];
+            order_scratch[slot] = order[i];
+        }
+        std::swap(keys, key_scratch);
+        std::swap(order, order_scratch);
+    }
+}
+
+size_t RenderQueue::batchEnd(size_t first) const {
+    const DrawItem &batch = (*this)[first];
+    size_t end = first + 1;
+    if (!batch.pooled)
+        return end;
+
+    for (; end < size() && end - first < MAX_MULTI_DRAWS; end++) {
+        const DrawItem &item = (*this)[end];
+        if (!item.pooled || item.program != batch.program || item.texture_target != batch.texture_target ||
+            item.textures[0] != batch.textures[0] || item.textures[1] != batch.textures[1] ||
+            item.mesh != batch.mesh || item.instances != batch.instances)
+            break;
+    }
+    return end;
+}
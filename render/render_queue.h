@@ -0,0 +1,72 @@
+//
+// Render queue: the draws of a frame are collected with a 64-bit sort key
+// and radix sorted before submission, so draws sharing a program, then a
+// texture set, then a vertex array are adjacent (the state cache skips the
+// repeated binds) and draws sharing all three go front to back for early z.
+//
+// Key, most significant first: program (12 bits), texture set (12 bits),
+// vertex array (12 bits), view depth (28 bits). Programs, texture sets and
+// vertex arrays get small ids in the order they are first queued.
+//
+
+#ifndef GL_TEST_RENDER_QUEUE_H
+#define GL_TEST_RENDER_QUEUE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include <vector>
+
+#include "instancing.h"
+#include "mesh.h"
+#include "mesh_pool.h"
+
+struct DrawItem {
+    const char *name = NULL; // GPU pass of the draw
+    GLuint program = 0;
+    GLenum texture_target = GL_TEXTURE_2D;
+    GLuint textures[2] = {0, 0}; // textures of units 0 and 1, 0 to leave a unit alone
+    const Mesh *mesh = NULL;
+    const InstanceBuffer *instances = NULL;
+
+    // Pooled meshes (mesh_pool.h), drawn by MultiDraw: `mesh` is the whole
+    // pool and `instances` is shared, these pick this draw's part of them
+    // and the layers of its maps in the texture array of unit 0
+    const PooledMesh *pooled = NULL;
+    GLuint first_instance = 0;
+    GLsizei instance_count = 0;
+    GLint layers[2] = {0, 0}; // diffuse, specular
+};
+
+// Binds the item's state (through the render state cache) and draws it.
+// Pooled items go through MultiDraw instead.
+void drawItem(const DrawItem &item);
+
+class RenderQueue {
+public:
+    void clear();
+    // `depth` is the view space depth of the item's nearest point
+    void add(const DrawItem &item, float depth);
+    // Orders the items by key; operator[] then walks them in that order
+    void sort();
+    // End of the run of sorted items from `first` that MultiDraw can submit
+    // together: pooled, sharing program, textures and pool, and at most
+    // MAX_MULTI_DRAWS of them. Just `first + 1` for other items.
+    size_t batchEnd(size_t first) const;
+
+    size_t size() const { return items.size(); }
+    const DrawItem &operator[](size_t i) const { return items[order[i]]; }
+
+private:
+    uint64_t sortKey(const DrawItem &item, float depth);
+
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order; // item of each sorted position
+    std::vector<uint64_t> key_scratch;
+    std::vector<uint32_t> order_scratch;
+
+    // Whatever got each id, kept across frames so keys stay stable
+    std::vector<uint64_t> program_ids, texture_set_ids, vao_ids;
+};
+
+#endif //GL_TEST_RENDER_QUEUE_H
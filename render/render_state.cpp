@@ -0,0 +1,133 @@
+//
+// Render state cache: skips binds of state that is already set.
+//
+
+#include "render_state.h"
+
+#include <stddef.h>
+
+// Shadowed texture targets, per unit
+enum TextureTarget {
+    TARGET_2D,
+    TARGET_2D_ARRAY,
+    TARGET_BUFFER,
+    TARGET_COUNT
+};
+
+// UNKNOWN never matches a real binding, so the first bind is always issued
+static const GLuint UNKNOWN = 0xffffffffu;
+
+static GLuint current_program = UNKNOWN;
+static GLuint current_vao = UNKNOWN;
+static GLuint active_unit = UNKNOWN;
+static GLuint textures[RENDER_STATE_TEXTURE_UNITS][TARGET_COUNT];
+static GLint viewport[4];
+static bool viewport_known = false;
+static bool textures_known = false;
+static RenderStateCounters counters;
+
+static int targetIndex(GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D: return TARGET_2D;
+        case GL_TEXTURE_2D_ARRAY: return TARGET_2D_ARRAY;
+        case GL_TEXTURE_BUFFER: return TARGET_BUFFER;
+        default: return -1;
+    }
+}
+
+static void forgetTextures() {
+    for (GLuint unit = 0; unit < RENDER_STATE_TEXTURE_UNITS; unit++) {
+        for (int target = 0; target < TARGET_COUNT; target++)
+            textures[unit][target] = UNKNOWN;
+    }
+    textures_known = true;
+}
+
+void useProgram(GLuint program) {
+    if (program == current_program) {
+        counters.elided++;
+        return;
+    }
+    glUseProgram(program);
+    current_program = program;
+    counters.issued++;
+}
+
+void bindVertexArray(GLuint vao) {
+    if (vao == current_vao) {
+        counters.elided++;
+        return;
+    }
+    glBindVertexArray(vao);
+    current_vao = vao;
+    counters.issued++;
+}
+
+void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (!textures_known)
+        forgetTextures();
+
+    int index = targetIndex(target);
+    GLuint *bound = unit < RENDER_STATE_TEXTURE_UNITS && index >= 0 ? &textures[unit][index] : NULL;
+    if (bound && *bound == texture) {
+        counters.elided += 2;
+        return;
+    }
+
+    if (unit != active_unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+        counters.issued++;
+    } else {
+        counters.elided++;
+    }
+    glBindTexture(target, texture);
+    counters.issued++;
+    if (bound)
+        *bound = texture;
+}
+
+void setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (viewport_known && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+        counters.elided++;
+        return;
+    }
+    glViewport(x, y, width, height);
+    viewport[0] = x;
+    viewport[1] = y;
+    viewport[2] = width;
+    viewport[3] = height;
+    viewport_known = true;
+    counters.issued++;
+}
+
+void renderStateReset() {
+    current_program = UNKNOWN;
+    current_vao = UNKNOWN;
+    active_unit = UNKNOWN;
+    viewport_known = false;
+    forgetTextures();
+}
+
+void renderStateForgetTextures(GLsizei count, const GLuint *deleted) {
+    if (!textures_known)
+        return;
+    for (GLsizei i = 0; i < count; i++) {
+        for (GLuint unit = 0; unit < RENDER_STATE_TEXTURE_UNITS; unit++) {
+            for (int target = 0; target < TARGET_COUNT; target++) {
+                // GL unbinds it, back to texture 0
+                if (textures[unit][target] == deleted[i])
+                    textures[unit][target] = 0;
+            }
+        }
+    }
+}
+
+void renderStateForgetVertexArray(GLuint vao) {
+    if (vao == current_vao)
+        current_vao = 0;
+}
+
+const RenderStateCounters &renderStateCounters() {
+    return counters;
+}
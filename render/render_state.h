@@ -0,0 +1,38 @@
+//
+// Render state cache: shadows the bound program, vertex array, textures of
+// every unit and the viewport, so binding what is already bound costs no
+// GL call. All binds of these must go through it (or be followed by
+// renderStateReset()) for the shadow to stay right.
+//
+
+#ifndef GL_TEST_RENDER_STATE_H
+#define GL_TEST_RENDER_STATE_H
+
+#include <GL/glew.h>
+
+// Units beyond this are always bound, never shadowed
+#define RENDER_STATE_TEXTURE_UNITS 16
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint vao);
+// Makes `unit` active only when the binding actually changes
+void bindTexture(GLuint unit, GLenum target, GLuint texture);
+void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// Forgets everything, for state changed behind the cache's back
+void renderStateReset();
+// Deleting a bound texture or vertex array unbinds it, and GL may hand its
+// name out again: call these before glDeleteTextures/glDeleteVertexArrays
+void renderStateForgetTextures(GLsizei count, const GLuint *textures);
+void renderStateForgetVertexArray(GLuint vao);
+
+// GL calls made and skipped so far. A texture bind counts as two calls (the
+// glActiveTexture and the glBindTexture an unconditional bind would make),
+// so issued + elided is what the calls would be without the cache.
+struct RenderStateCounters {
+    unsigned long issued = 0;
+    unsigned long elided = 0;
+};
+const RenderStateCounters &renderStateCounters();
+
+#endif //GL_TEST_RENDER_STATE_H
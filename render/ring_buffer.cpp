@@ -0,0 +1,101 @@
+//
+// Persistently mapped ring buffer for per-frame data, fenced per region.
+//
+
+#include "ring_buffer.h"
+
+#include <chrono>
+#include <stdio.h>
+
+bool RingBuffer::supported() {
+    return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+}
+
+bool RingBuffer::create(GLsizeiptr size, unsigned frames) {
+    frame_size = size > 0 ? size : 1;
+    fences.assign(frames > 0 ? frames : 1, (GLsync) 0);
+    current = 0;
+    used = 0;
+
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uniform_alignment = alignment > 0 ? alignment : 1;
+
+    // Immutable storage, so the mapping stays valid while the GPU reads it;
+    // coherent, so writes need no explicit flush before the draws
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr total = frame_size * (GLsizeiptr) fences.size();
+    glGenBuffers(1, &buffer_object);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_object);
+    glBufferStorage(GL_ARRAY_BUFFER, total, NULL, flags);
+    mapped = (char *) glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+    if (!mapped) {
+        fprintf(stderr, "ERROR: could not map a %ld byte ring buffer persistently\n", (long) total);
+        destroy();
+        return false;
+    }
+
+    return true;
+}
+
+void RingBuffer::destroy() {
+    for (GLsync &fence : fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    // (deleting the buffer unmaps it)
+    if (buffer_object)
+        glDeleteBuffers(1, &buffer_object);
+    buffer_object = 0;
+    mapped = NULL;
+}
+
+void RingBuffer::beginFrame() {
+    // The region was last written `frames` frames ago
+    GLsync &fence = fences[current];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            auto start = std::chrono::steady_clock::now();
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            waits++;
+            wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (status == GL_WAIT_FAILED)
+            fprintf(stderr, "ERROR: waiting for a ring buffer fence failed\n");
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    used = 0;
+}
+
+void RingBuffer::endFrame() {
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % fences.size();
+}
+
+void *RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset) {
+    if (!mapped)
+        return NULL;
+
+    GLsizeiptr region = (GLsizeiptr) current * frame_size;
+    GLsizeiptr aligned = (region + used + alignment - 1) / alignment * alignment;
+    if (aligned + size > region + frame_size) {
+        if (!overflowed)
+            fprintf(stderr, "ERROR: the %ld byte ring buffer regions are too small for a frame\n",
+                    (long) frame_size);
+        overflowed = true;
+        return NULL;
+    }
+
+    used = aligned + size - region;
+    offset = aligned;
+    return mapped + aligned;
+}
+
+void *RingBuffer::allocateUniform(GLsizeiptr size, GLintptr &offset) {
+    return allocate(size, uniform_alignment, offset);
+}
@@ -0,0 +1,65 @@
+//
+// Ring buffer for data streamed every frame: one buffer object with immutable
+// storage, mapped once for good (GL_MAP_PERSISTENT_BIT |
+// GL_MAP_COHERENT_BIT) and split in one region per frame in flight. The CPU
+// writes a frame's uniform blocks, instances and draw commands straight into
+// the frame's region and the draws read them from there through buffer
+// offsets, with no copy in the driver. A fence placed after each frame
+// guards its region; the CPU only waits on it when the region comes round
+// again, `frames` frames later, by which time the GPU is usually done.
+//
+
+#ifndef GL_TEST_RING_BUFFER_H
+#define GL_TEST_RING_BUFFER_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <vector>
+
+class RingBuffer {
+public:
+    // Buffer storage (OpenGL 4.4) and fences (OpenGL 3.2)
+    static bool supported();
+
+    // Maps `frames` regions of `frame_size` bytes, enough for everything a
+    // frame writes (allocations are aligned, count the padding in)
+    bool create(GLsizeiptr frame_size, unsigned frames = 3);
+    void destroy();
+
+    // Brackets a frame: beginFrame() waits for the GPU to be done with the
+    // next region, endFrame() fences it after the frame's last draw
+    void beginFrame();
+    void endFrame();
+
+    // `size` bytes of the current region at an offset from the start of the
+    // buffer that is a multiple of `alignment` (any positive value, e.g. an
+    // instance stride), written there as `offset`; NULL when the region is
+    // full
+    void *allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset);
+    // Same, aligned for glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    void *allocateUniform(GLsizeiptr size, GLintptr &offset);
+
+    GLuint buffer() const { return buffer_object; }
+    GLsizeiptr frameSize() const { return frame_size; }
+    GLsizeiptr uniformAlignment() const { return uniform_alignment; }
+    size_t frameCount() const { return fences.size(); }
+
+    // Frames that found their region still in use and the time spent
+    // waiting for it
+    unsigned long long fenceWaits() const { return waits; }
+    double fenceWaitMs() const { return wait_ms; }
+
+private:
+    GLuint buffer_object = 0;
+    char *mapped = NULL;
+    GLsizeiptr frame_size = 0;
+    GLsizeiptr uniform_alignment = 1;
+    std::vector<GLsync> fences; // one per region, 0 when not in flight
+    size_t current = 0;
+    GLsizeiptr used = 0; // bytes of the current region handed out
+    bool overflowed = false;
+    unsigned long long waits = 0;
+    double wait_ms = 0.0;
+};
+
+#endif //GL_TEST_RING_BUFFER_H
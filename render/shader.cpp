@@ -0,0 +1,89 @@
+//
+// Shader compilation and program linking, backed by the program binary cache.
+//
+
+#include "shader.h"
+#include "program_cache.h"
+
+#include <stdio.h>
+
+GLuint compileShader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    int  success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        printf("ERROR: %s Shader compilation failed!\n%s\n",
+               type == GL_VERTEX_SHADER ? "Vertex" : "Fragment", infoLog);
+        glDeleteShader(shader);
+
+        return 0;
+    }
+
+    return shader;
+}
+
+GLuint createProgram(const char *vertex_source, const char *fragment_source, ProgramSetupFunc setup,
+                     const char *cache_dir, bool *from_cache) {
+    if (from_cache)
+        *from_cache = false;
+
+    bool use_cache = cache_dir && programBinarySupported();
+    uint64_t key = 0;
+    if (use_cache) {
+        const char *sources[] = {vertex_source, fragment_source};
+        key = programCacheKey(sources, 2);
+
+        GLuint program = programCacheLoad(cache_dir, key);
+        if (program) {
+            if (from_cache)
+                *from_cache = true;
+            return program;
+        }
+    }
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertex_source);
+    if (!vs)
+        return 0;
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragment_source);
+    if (!fs) {
+        glDeleteShader(vs);
+        return 0;
+    }
+
+    // Create program, attach shaders to it and link it
+    GLuint program = glCreateProgram();
+    glAttachShader(program, fs);
+    glAttachShader(program, vs);
+    if (setup)
+        setup(program);
+    if (use_cache)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+
+    // Release shader objects
+    glDetachShader(program, vs);
+    glDetachShader(program, fs);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    int  success;
+    char infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        printf("ERROR: Shader Program linking failed!\n%s\n", infoLog);
+        glDeleteProgram(program);
+
+        return 0;
+    }
+
+    if (use_cache)
+        programCacheStore(cache_dir, key, program);
+
+    return program;
+}
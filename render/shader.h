@@ -0,0 +1,27 @@
+//
+// Shader compilation and program linking, backed by the program binary cache.
+//
+
+#ifndef GL_TEST_SHADER_H
+#define GL_TEST_SHADER_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+
+// Called between attaching the shaders and linking (attribute bindings)
+typedef void (*ProgramSetupFunc)(GLuint program);
+
+// Compiles one stage; returns 0 and prints the info log on failure.
+GLuint compileShader(GLenum type, const char *source);
+
+// Builds the program for the given sources. With a `cache_dir` the linked
+// binary is reloaded from disk when the sources and driver still match, and
+// stored after a fresh compile otherwise. Returns 0 on failure.
+//
+// State set after linking (uniform values, uniform block bindings) is not
+// part of the binary: callers must set it whether the program came from the
+// cache or not.
+GLuint createProgram(const char *vertex_source, const char *fragment_source, ProgramSetupFunc setup,
+                     const char *cache_dir = NULL, bool *from_cache = NULL);
+
+#endif //GL_TEST_SHADER_H
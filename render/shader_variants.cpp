@@ -0,0 +1,66 @@
+//
+// Shader permutations, compiled on demand.
+//
+
+#include "shader_variants.h"
+#include "uniform_cache.h"
+
+#include <string.h>
+
+std::string injectDefines(const char *source, const ShaderVariantKey &key) {
+    std::string defines;
+    if (key.lights >= 0)
+        defines += "#define NR_POINT_LIGHTS " + std::to_string(key.lights) + "\n";
+    if (key.features & SHADER_TEXTURES)
+        defines += "#define USE_TEXTURES\n";
+    if (key.features & SHADER_MULTI_DRAW)
+        defines += "#define MULTI_DRAW\n";
+
+    // #version must stay the first statement
+    const char *body = source;
+    int body_line = 1;
+    if (!strncmp(source, "#version", 8)) {
+        const char *newline = strchr(source, '\n');
+        body = newline ? newline + 1 : source + strlen(source);
+        body_line = 2;
+    }
+
+    return std::string(source, body) + defines + "#line " + std::to_string(body_line) + "\n" + body;
+}
+
+ShaderVariants::ShaderVariants(const char *vertex_source, const char *fragment_source, ProgramSetupFunc setup,
+                               ProgramInitFunc init, const char *cache_dir)
+    : vertex_source(vertex_source), fragment_source(fragment_source), setup(setup), init(init),
+      cache_dir(cache_dir) {
+}
+
+ShaderVariants::~ShaderVariants() {
+    for (auto &variant : programs) {
+        if (!variant.second)
+            continue;
+        uniformCacheRelease(variant.second);
+        glDeleteProgram(variant.second);
+    }
+}
+
+GLuint ShaderVariants::program(const ShaderVariantKey &key) {
+    auto found = programs.find(key);
+    if (found != programs.end())
+        return found->second;
+
+    std::string vs = injectDefines(vertex_source.c_str(), key);
+    std::string fs = injectDefines(fragment_source.c_str(), key);
+    bool from_cache = false;
+    GLuint program = createProgram(vs.c_str(), fs.c_str(), setup, cache_dir, &from_cache);
+    programs[key] = program;
+    if (!program) {
+        failed++;
+        return 0;
+    }
+    if (from_cache)
+        cached++;
+    if (init)
+        init(program, key);
+
+    return program;
+}
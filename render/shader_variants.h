@@ -0,0 +1,69 @@
+//
+// Shader permutations: one pair of sources compiled with different #defines
+// for every combination of features a draw needs, so a fragment never pays
+// for lights or texture fetches it does not use.
+//
+// Defines injected after the #version line:
+//   NR_POINT_LIGHTS n   lights evaluated per fragment (when the key sets it)
+//   USE_TEXTURES        diffuse/specular maps, flat material colours otherwise
+//   MULTI_DRAW          drawn by MultiDraw: maps are layers of a texture array
+//
+
+#ifndef GL_TEST_SHADER_VARIANTS_H
+#define GL_TEST_SHADER_VARIANTS_H
+
+#include <GL/glew.h>
+#include <map>
+#include <string>
+
+#include "shader.h"
+
+enum ShaderFeature {
+    SHADER_TEXTURES = 1 << 0,
+    SHADER_MULTI_DRAW = 1 << 1
+};
+
+struct ShaderVariantKey {
+    int lights = -1;        // NR_POINT_LIGHTS, -1: left to the shader
+    unsigned features = 0;  // ShaderFeature bits
+
+    bool operator<(const ShaderVariantKey &other) const {
+        return lights != other.lights ? lights < other.lights : features < other.features;
+    }
+};
+
+// `source` with the defines of `key` inserted after its #version line. A
+// #line directive keeps the compiler's line numbers those of the file.
+std::string injectDefines(const char *source, const ShaderVariantKey &key);
+
+// Called once per new variant, after linking (uniform blocks, samplers and
+// other uniforms that never change)
+typedef void (*ProgramInitFunc)(GLuint program, const ShaderVariantKey &key);
+
+class ShaderVariants {
+public:
+    // Copies the sources; `setup` and `cache_dir` are passed to createProgram().
+    ShaderVariants(const char *vertex_source, const char *fragment_source, ProgramSetupFunc setup,
+                   ProgramInitFunc init, const char *cache_dir = NULL);
+    ~ShaderVariants();
+
+    // Program of the variant, built (or loaded from the binary cache) and
+    // initialised on first use. Returns 0 if it fails to compile; the failure
+    // is remembered, so the variant is not rebuilt (nor its errors printed)
+    // on every later call.
+    GLuint program(const ShaderVariantKey &key);
+
+    size_t size() const { return programs.size() - failed; } // variants built
+    size_t cachedCount() const { return cached; } // variants loaded as program binaries
+
+private:
+    std::string vertex_source, fragment_source;
+    ProgramSetupFunc setup;
+    ProgramInitFunc init;
+    const char *cache_dir;
+    std::map<ShaderVariantKey, GLuint> programs; // 0 for variants that failed
+    size_t cached = 0;
+    size_t failed = 0;
+};
+
+#endif //GL_TEST_SHADER_VARIANTS_H
@@ -0,0 +1,213 @@
+//
+// On-disk cache of decoded, mipmapped textures, memory-mapped on load.
+//
+
+#include "texture_cache.h"
+#include "../util/hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char TEXTURE_CACHE_MAGIC[4] = {'P', 'T', 'E', 'X'};
+static const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+// File layout: header, source path, padding, then every mip level (tightly
+// packed rows) back to back starting at data_offset.
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint32_t path_length;
+    int32_t width, height, components, levels;
+    uint32_t reserved;
+    uint64_t data_offset;
+};
+
+// Identifies a source file: its absolute path (when it can be resolved) and
+// the size/mtime that must still match for an entry to be valid
+struct SourceKey {
+    std::string path;
+    struct stat st;
+};
+
+static bool sourceKey(const char *source, SourceKey &key) {
+    if (stat(source, &key.st) != 0)
+        return false;
+
+    char resolved[PATH_MAX];
+    key.path = realpath(source, resolved) ? resolved : source;
+    return true;
+}
+
+static std::string cacheFilePath(const char *cache_dir, const SourceKey &key) {
+    return std::string(cache_dir) + "/" + hashToHex(fnv1a64(key.path)) + ".ptex";
+}
+
+void generateMipmaps(DecodedImage &image) {
+    int levels = 1;
+    while (mipLevelWidth(image, levels - 1) > 1 || mipLevelHeight(image, levels - 1) > 1)
+        levels++;
+
+    // Allocate every level at once: level pointers must stay valid
+    size_t storage = 0;
+    for (int level = 1; level < levels; level++)
+        storage += mipLevelSize(image, level);
+    image.mip_storage.assign(storage, 0);
+
+    image.levels.assign(1, image.pixels);
+    unsigned char *dst = image.mip_storage.data();
+    const int c = image.components;
+    for (int level = 1; level < levels; level++) {
+        const unsigned char *src = image.levels[level - 1];
+        int src_w = mipLevelWidth(image, level - 1), src_h = mipLevelHeight(image, level - 1);
+        int dst_w = mipLevelWidth(image, level), dst_h = mipLevelHeight(image, level);
+
+        // 2x2 box filter; odd edges reuse the last row/column
+        for (int y = 0; y < dst_h; y++) {
+            int y0 = 2 * y, y1 = 2 * y + 1 < src_h ? 2 * y + 1 : src_h - 1;
+            for (int x = 0; x < dst_w; x++) {
+                int x0 = 2 * x, x1 = 2 * x + 1 < src_w ? 2 * x + 1 : src_w - 1;
+                for (int k = 0; k < c; k++) {
+                    int sum = src[((size_t) y0 * src_w + x0) * c + k] + src[((size_t) y0 * src_w + x1) * c + k] +
+                              src[((size_t) y1 * src_w + x0) * c + k] + src[((size_t) y1 * src_w + x1) * c + k];
+                    dst[((size_t) y * dst_w + x) * c + k] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+
+        image.levels.push_back(dst);
+        dst += mipLevelSize(image, level);
+    }
+}
+
+bool textureCacheLoad(const char *cache_dir, const char *source, DecodedImage &image) {
+    SourceKey key;
+    if (!sourceKey(source, key))
+        return false;
+
+    std::string file = cacheFilePath(cache_dir, key);
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(TextureCacheHeader))
+        mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    const unsigned char *bytes = (const unsigned char *) mapping;
+    TextureCacheHeader header;
+    memcpy(&header, bytes, sizeof(header));
+
+    bool valid = memcmp(header.magic, TEXTURE_CACHE_MAGIC, 4) == 0 &&
+                 header.version == TEXTURE_CACHE_VERSION &&
+                 header.source_size == (uint64_t) key.st.st_size &&
+                 header.source_mtime_sec == (int64_t) key.st.st_mtim.tv_sec &&
+                 header.source_mtime_nsec == (int64_t) key.st.st_mtim.tv_nsec &&
+                 header.path_length == key.path.size() &&
+                 sizeof(header) + header.path_length <= (size_t) st.st_size &&
+                 memcmp(bytes + sizeof(header), key.path.data(), key.path.size()) == 0 &&
+                 header.width > 0 && header.height > 0 && header.levels > 0 && header.levels <= 32 &&
+                 header.components >= 1 && header.components <= 4;
+
+    if (valid) {
+        image.path = source;
+        image.width = header.width;
+        image.height = header.height;
+        image.components = header.components;
+
+        size_t offset = header.data_offset;
+        image.levels.clear();
+        for (int level = 0; level < header.levels && valid; level++) {
+            size_t size = mipLevelSize(image, level);
+            valid = offset + size <= (size_t) st.st_size;
+            image.levels.push_back(bytes + offset);
+            offset += size;
+        }
+    }
+
+    if (!valid) {
+        // Stale (source changed) or truncated: the caller decodes and rewrites it
+        munmap(mapping, st.st_size);
+        image.levels.clear();
+        return false;
+    }
+
+    // Upload reads every level once, front to back
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    image.pixels = (unsigned char *) image.levels[0];
+    image.mapping = mapping;
+    image.mapping_size = st.st_size;
+    image.from_cache = true;
+
+    return true;
+}
+
+bool textureCacheStore(const char *cache_dir, const char *source, DecodedImage &image) {
+    SourceKey key;
+    if (!image.pixels || !sourceKey(source, key))
+        return false;
+
+    if (image.levels.empty())
+        generateMipmaps(image);
+
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "WARNING: could not create texture cache directory %s\n", cache_dir);
+        return false;
+    }
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    header.source_size = key.st.st_size;
+    header.source_mtime_sec = key.st.st_mtim.tv_sec;
+    header.source_mtime_nsec = key.st.st_mtim.tv_nsec;
+    header.path_length = (uint32_t) key.path.size();
+    header.width = image.width;
+    header.height = image.height;
+    header.components = image.components;
+    header.levels = (int32_t) image.levels.size();
+    // Page-align the pixels, so level 0 starts on its own page once mapped
+    header.data_offset = (sizeof(header) + key.path.size() + 4095) & ~(uint64_t) 4095;
+
+    // Write to a temporary name and rename: readers never see partial files
+    std::string file = cacheFilePath(cache_dir, key);
+    std::string temporary = file + ".tmp" + std::to_string(getpid()) + "_" + hashToHex(fnv1a64(source));
+    FILE *fp = fopen(temporary.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "WARNING: could not write texture cache file %s\n", temporary.c_str());
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(key.path.data(), 1, key.path.size(), fp);
+    fseek(fp, (long) header.data_offset, SEEK_SET);
+    for (int level = 0; level < (int) image.levels.size(); level++)
+        fwrite(image.levels[level], 1, mipLevelSize(image, level), fp);
+
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+        ok = rename(temporary.c_str(), file.c_str()) == 0;
+    if (!ok) {
+        fprintf(stderr, "WARNING: could not write texture cache file %s\n", file.c_str());
+        unlink(temporary.c_str());
+    }
+
+    return ok;
+}
@@ -0,0 +1,24 @@
+//
+// On-disk cache of decoded, mipmapped textures, memory-mapped on load.
+//
+// Each source image gets one file in the cache directory, named after a hash
+// of its path. The header records the source size and modification time, so
+// editing the source image invalidates its entry automatically.
+//
+
+#ifndef GL_TEST_TEXTURE_CACHE_H
+#define GL_TEST_TEXTURE_CACHE_H
+
+#include "texture_loader.h"
+
+// Maps the cached entry for `source` into `image` (all mip levels, read-only,
+// straight from the page cache). Fails when there is no entry or it is stale.
+bool textureCacheLoad(const char *cache_dir, const char *source, DecodedImage &image);
+
+// Stores a decoded image and its mip chain (generated if `image` has none).
+bool textureCacheStore(const char *cache_dir, const char *source, DecodedImage &image);
+
+// 2x2 box-filtered mip chain down to 1x1, appended after level 0.
+void generateMipmaps(DecodedImage &image);
+
+#endif //GL_TEST_TEXTURE_CACHE_H
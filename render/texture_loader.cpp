@@ -0,0 +1,197 @@
+//
+// Texture loading: JPEG/PNG decoding (thread-safe, no GL) and GL upload.
+//
+
+#include "texture_loader.h"
+#include "render_state.h"
+#include "texture_cache.h"
+#include "../util/profiler.h"
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdio.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+bool decodeImage(const char *path, DecodedImage &image) {
+    image.path = path;
+    // Images: 0.0 top of y-axis  OpenGL: 0.0 bottom of y-axis
+    stbi_set_flip_vertically_on_load_thread(1);
+    image.pixels = stbi_load(path, &image.width, &image.height, &image.components, 0);
+    image.stb_allocated = image.pixels != NULL;
+
+    return image.pixels != NULL;
+}
+
+void freeImage(DecodedImage &image) {
+    if (image.stb_allocated)
+        stbi_image_free(image.pixels);
+    if (image.mapping)
+        munmap(image.mapping, image.mapping_size);
+
+    image.pixels = NULL;
+    image.levels.clear();
+    image.stb_allocated = false;
+    image.mip_storage.clear();
+    image.mip_storage.shrink_to_fit();
+    image.mapping = NULL;
+    image.mapping_size = 0;
+}
+
+void uploadTexture(GLuint texture, const DecodedImage &image) {
+    // Sized internal formats, so texture arrays can take copies of the levels
+    GLenum format = GL_RGB;
+    GLint internal_format = GL_RGB8;
+    if (image.components == 1) {
+        format = GL_RED;
+        internal_format = GL_R8;
+    } else if (image.components == 4) {
+        format = GL_RGBA;
+        internal_format = GL_RGBA8;
+    }
+
+    bindTexture(0, GL_TEXTURE_2D, texture);
+    // Rows of 1 or 3 byte pixels are not necessarily 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (image.levels.empty()) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        for (int level = 0; level < (int) image.levels.size(); level++)
+            glTexImage2D(GL_TEXTURE_2D, level, internal_format, mipLevelWidth(image, level), mipLevelHeight(image, level),
+                         0, format, GL_UNSIGNED_BYTE, image.levels[level]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) image.levels.size() - 1);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+GLuint loadTexture(const char *path) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+
+    DecodedImage image;
+    if (decodeImage(path, image))
+        uploadTexture(texture, image);
+    else
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    freeImage(image);
+
+    return texture;
+}
+
+std::vector<GLuint> loadTextures(const std::vector<std::string> &paths, ThreadPool &pool,
+                                 const char *cache_dir, size_t *cache_hits) {
+    std::vector<GLuint> textures(paths.size());
+    if (!textures.empty())
+        glGenTextures((GLsizei) textures.size(), textures.data());
+
+    // Decoded images, handed from the workers to this thread in completion order
+    std::vector<DecodedImage> images(paths.size());
+    std::deque<size_t> decoded;
+    std::mutex mutex;
+    std::condition_variable image_ready;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        pool.submit([&, i] {
+            PROFILE_SCOPE("decode texture");
+            const char *path = paths[i].c_str();
+            if (!cache_dir || !textureCacheLoad(cache_dir, path, images[i])) {
+                if (decodeImage(path, images[i]) && cache_dir)
+                    textureCacheStore(cache_dir, path, images[i]);
+            }
+            // Notified under the lock: once it is released the last upload
+            // may return and take mutex, image_ready and decoded with it
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(i);
+            image_ready.notify_one();
+        });
+    }
+
+    if (cache_hits)
+        *cache_hits = 0;
+    for (size_t uploaded = 0; uploaded < paths.size(); uploaded++) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            image_ready.wait(lock, [&] { return !decoded.empty(); });
+            i = decoded.front();
+            decoded.pop_front();
+        }
+
+        PROFILE_SCOPE("upload texture");
+        if (images[i].pixels)
+            uploadTexture(textures[i], images[i]);
+        else
+            std::cout << "Texture failed to load at path: " << paths[i] << std::endl;
+        if (cache_hits && images[i].from_cache)
+            (*cache_hits)++;
+        freeImage(images[i]);
+    }
+
+    return textures;
+}
+
+GLuint createTextureArray(const std::vector<GLuint> &textures) {
+    if (textures.empty() || !(GLEW_VERSION_4_3 || (GLEW_ARB_copy_image && GLEW_ARB_texture_storage)))
+        return 0;
+
+    GLint width = 0, height = 0, format = 0, levels = 0;
+    for (size_t i = 0; i < textures.size(); i++) {
+        GLint texture_width, texture_height, texture_format, max_level, texture_levels = 0;
+        bindTexture(0, GL_TEXTURE_2D, textures[i]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texture_width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texture_height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &texture_format);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+        for (GLint level_width = texture_width; level_width > 0 && texture_levels <= max_level; texture_levels++)
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, texture_levels + 1, GL_TEXTURE_WIDTH, &level_width);
+
+        if (i == 0) {
+            width = texture_width;
+            height = texture_height;
+            format = texture_format;
+            levels = texture_levels;
+        } else if (texture_width != width || texture_height != height || texture_format != format) {
+            fprintf(stderr, "ERROR: texture %zu is %dx%d (format 0x%x), not %dx%d (0x%x) like the first\n", i,
+                    texture_width, texture_height, texture_format, width, height, format);
+            return 0;
+        }
+        levels = std::min(levels, texture_levels);
+    }
+    if (width == 0 || levels == 0)
+        return 0;
+
+    GLuint array;
+    glGenTextures(1, &array);
+    bindTexture(0, GL_TEXTURE_2D_ARRAY, array);
+    glGetError();
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, format, width, height, (GLsizei) textures.size());
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: no texture array storage for format 0x%x\n", format);
+        renderStateForgetTextures(1, &array);
+        glDeleteTextures(1, &array);
+        return 0;
+    }
+    for (GLint level = 0; level < levels; level++) {
+        GLsizei level_width = std::max(width >> level, 1), level_height = std::max(height >> level, 1);
+        for (size_t layer = 0; layer < textures.size(); layer++)
+            glCopyImageSubData(textures[layer], GL_TEXTURE_2D, level, 0, 0, 0, array, GL_TEXTURE_2D_ARRAY, level,
+                               0, 0, (GLint) layer, level_width, level_height, 1);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return array;
+}
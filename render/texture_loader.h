@@ -0,0 +1,71 @@
+//
+// Texture loading: JPEG/PNG decoding (thread-safe, no GL) and GL upload.
+//
+
+#ifndef GL_TEST_TEXTURE_LOADER_H
+#define GL_TEST_TEXTURE_LOADER_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+#include "../util/thread_pool.h"
+
+struct DecodedImage {
+    std::string path;
+    unsigned char *pixels = NULL; // level 0, tightly packed rows
+    int width = 0, height = 0;
+    int components = 0; // 1: red, 3: RGB, 4: RGBA
+
+    // Whole mip chain, level 0 first, when it was precomputed (texture cache);
+    // empty lets the GL generate the mipmaps on upload.
+    std::vector<const unsigned char *> levels;
+    bool from_cache = false;
+
+    // Owners of the pixel memory: stb_image, generated mips or a file mapping
+    bool stb_allocated = false;
+    std::vector<unsigned char> mip_storage;
+    void *mapping = NULL;
+    size_t mapping_size = 0;
+};
+
+inline int mipLevelWidth(const DecodedImage &image, int level) {
+    return image.width >> level > 0 ? image.width >> level : 1;
+}
+
+inline int mipLevelHeight(const DecodedImage &image, int level) {
+    return image.height >> level > 0 ? image.height >> level : 1;
+}
+
+inline size_t mipLevelSize(const DecodedImage &image, int level) {
+    return (size_t) mipLevelWidth(image, level) * mipLevelHeight(image, level) * image.components;
+}
+
+// Decodes an image file with stb_image; safe to call from any thread.
+// Images are flipped vertically (OpenGL's t = 0 is the bottom row).
+bool decodeImage(const char *path, DecodedImage &image);
+void freeImage(DecodedImage &image);
+
+// Uploads a decoded image into `texture` (mipmapped, repeat wrapping). The
+// pixels are read in place, so mapped cache files go straight to the driver.
+// Must run on the thread owning the GL context.
+void uploadTexture(GLuint texture, const DecodedImage &image);
+
+// Synchronous decode + upload of a single texture.
+GLuint loadTexture(const char *path);
+
+// Decodes every image in parallel on `pool` while the calling (GL) thread
+// uploads each one as soon as its decode completes. Returns the textures in
+// the order of `paths`; failed loads leave an empty texture, as loadTexture.
+// With a `cache_dir`, images come from the texture cache when their entry is
+// up to date and are added to it otherwise; `cache_hits` counts the former.
+std::vector<GLuint> loadTextures(const std::vector<std::string> &paths, ThreadPool &pool,
+                                 const char *cache_dir = NULL, size_t *cache_hits = NULL);
+
+// Copies textures of the same size and format, with their mip levels, into
+// the layers of a new 2D array texture sampled like uploadTexture's (one
+// bind serves every material). Returns 0 if they differ or image copies
+// (OpenGL 4.3) are not supported.
+GLuint createTextureArray(const std::vector<GLuint> &textures);
+
+#endif //GL_TEST_TEXTURE_LOADER_H
@@ -0,0 +1,40 @@
+//
+// std140 uniform blocks shared by the Phong shaders, mirrored on the CPU.
+//
+
+#include "uniform_blocks.h"
+
+#include <string.h>
+
+GLuint createUniformBuffer(GLsizeiptr size, GLuint binding) {
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+
+    return buffer;
+}
+
+void updateUniformBuffer(GLuint buffer, GLsizeiptr size, const void *data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+}
+
+void streamUniformBlock(RingBuffer *ring, GLuint buffer, GLuint binding, const void *data, GLsizeiptr size) {
+    GLintptr offset = 0;
+    void *dst = ring ? ring->allocateUniform(size, offset) : NULL;
+    if (dst) {
+        memcpy(dst, data, size);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer(), offset, size);
+    } else {
+        updateUniformBuffer(buffer, size, data);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+}
+
+void bindUniformBlock(GLuint program, const char *block, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, block);
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, binding);
+}
@@ -0,0 +1,88 @@
+//
+// std140 uniform blocks shared by the Phong shaders, mirrored on the CPU.
+//
+
+#ifndef GL_TEST_UNIFORM_BLOCKS_H
+#define GL_TEST_UNIFORM_BLOCKS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ring_buffer.h"
+
+// Main lights; fragment shader variants may use fewer (their NR_POINT_LIGHTS)
+#define NR_POINT_LIGHTS 2
+
+// Binding points, fixed for every program
+enum UniformBlockBinding {
+    CAMERA_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1,
+    CLUSTERS_BLOCK_BINDING = 2,
+    DRAWS_BLOCK_BINDING = 3
+};
+
+// layout(std140) uniform Camera: vec3 members take a whole vec4 slot
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 view_pos;
+};
+
+// One element of `Light lights[NR_POINT_LIGHTS]` in layout(std140) uniform Lights
+struct LightBlockEntry {
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+struct LightsBlock {
+    LightBlockEntry lights[NR_POINT_LIGHTS];
+};
+
+// layout(std140) uniform Clusters: grid of the clustered light lists
+struct ClustersBlock {
+    glm::ivec2 tiles;
+    GLint tile_size;
+    GLint slices;
+    glm::vec2 depth_scale_bias; // slice = log(view depth) * x + y
+    glm::vec2 padding;
+};
+
+// Draws of one glMultiDrawElementsIndirect call, the size of the Draws block
+#define MAX_MULTI_DRAWS 256
+
+// One element of `ivec4 draws[MAX_MULTI_DRAWS]` in layout(std140) uniform
+// Draws, indexed by gl_DrawIDARB: texture array layers of the draw's maps
+struct DrawBlockEntry {
+    GLint diffuse_layer;
+    GLint specular_layer;
+    GLint padding[2];
+};
+
+struct DrawsBlock {
+    DrawBlockEntry draws[MAX_MULTI_DRAWS];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must follow std140 layout");
+static_assert(sizeof(LightBlockEntry) == 64, "LightBlockEntry must follow std140 layout");
+static_assert(sizeof(ClustersBlock) == 32, "ClustersBlock must follow std140 layout");
+static_assert(sizeof(DrawBlockEntry) == 16, "DrawBlockEntry must follow std140 layout");
+
+// Creates a uniform buffer of `size` bytes attached to `binding`.
+GLuint createUniformBuffer(GLsizeiptr size, GLuint binding);
+
+// Replaces the whole buffer contents; the old storage is orphaned so the
+// update never waits for draws still reading last frame's data.
+void updateUniformBuffer(GLuint buffer, GLsizeiptr size, const void *data);
+
+// This frame's contents of the block at `binding`: written into `ring`'s
+// current region and bound as a range of it, or, without a ring (or room in
+// it), uploaded to `buffer` with updateUniformBuffer() and bound whole.
+void streamUniformBlock(RingBuffer *ring, GLuint buffer, GLuint binding, const void *data, GLsizeiptr size);
+
+// Points the named block of `program` to `binding`. Blocks optimised out by
+// the compiler are ignored.
+void bindUniformBlock(GLuint program, const char *block, GLuint binding);
+
+#endif //GL_TEST_UNIFORM_BLOCKS_H
@@ -0,0 +1,86 @@
+//
+// Uniform location cache: every location is resolved once, right after a
+// program is linked, so the per-frame path never queries the driver.
+//
+
+#include "uniform_cache.h"
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::unordered_map<std::string, GLint> LocationMap;
+
+static std::unordered_map<GLuint, LocationMap> program_locations;
+static unsigned long lookup_count = 0;
+
+static GLint lookupLocation(GLuint program, const char *name) {
+    lookup_count++;
+    return glGetUniformLocation(program, name);
+}
+
+void uniformCacheBuild(GLuint program) {
+    LocationMap &locations = program_locations[program];
+    locations.clear();
+
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    // Members of uniform blocks have no location (-1, which a cache miss
+    // returns as well): skip them, arrays in blocks would cost a lookup per
+    // element
+    std::vector<GLuint> indices(count);
+    std::vector<GLint> block_indices(count, -1);
+    for (GLint i = 0; i < count; i++)
+        indices[i] = (GLuint) i;
+    if (count > 0)
+        glGetActiveUniformsiv(program, count, indices.data(), GL_UNIFORM_BLOCK_INDEX, block_indices.data());
+
+    std::vector<char> name(max_length > 0 ? max_length : 1);
+    for (GLint i = 0; i < count; i++) {
+        if (block_indices[i] != -1)
+            continue;
+
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(program, i, (GLsizei) name.size(), &length, &size, &type, name.data());
+        std::string uniform(name.data(), length);
+
+        GLint location = lookupLocation(program, uniform.c_str());
+        locations[uniform] = location;
+
+        // Arrays of basic types are reported as "name[0]": also accept "name"
+        // and resolve the remaining elements
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0) {
+            std::string base = uniform.substr(0, uniform.size() - 3);
+            locations[base] = location;
+            for (GLint element = 1; element < size; element++) {
+                std::string element_name = base + "[" + std::to_string(element) + "]";
+                locations[element_name] = lookupLocation(program, element_name.c_str());
+            }
+        }
+    }
+}
+
+void uniformCacheRelease(GLuint program) {
+    program_locations.erase(program);
+}
+
+GLint uniformLocation(GLuint program, const char *name) {
+    auto cached_program = program_locations.find(program);
+    if (cached_program == program_locations.end()) {
+        fprintf(stderr, "WARNING: uniform '%s' requested from uncached program %u\n", name, program);
+        return lookupLocation(program, name);
+    }
+
+    auto cached = cached_program->second.find(name);
+    // Not among the active uniforms: the driver would answer -1 as well
+    return cached != cached_program->second.end() ? cached->second : -1;
+}
+
+unsigned long uniformLookupCount() {
+    return lookup_count;
+}
@@ -0,0 +1,25 @@
+//
+// Uniform location cache: every location is resolved once, right after a
+// program is linked, so the per-frame path never queries the driver.
+//
+
+#ifndef GL_TEST_UNIFORM_CACHE_H
+#define GL_TEST_UNIFORM_CACHE_H
+
+#include <GL/glew.h>
+
+// Queries the locations of all active uniforms of a linked program. Call it
+// again after relinking, and uniformCacheRelease() before deleting the
+// program, so a later program reusing its name gets no stale locations.
+void uniformCacheBuild(GLuint program);
+void uniformCacheRelease(GLuint program);
+
+// Cached location of `name`, or -1 when it is not an active uniform (exactly
+// what glGetUniformLocation would return). Programs never passed to
+// uniformCacheBuild() fall back to asking the driver.
+GLint uniformLocation(GLuint program, const char *name);
+
+// Number of glGetUniformLocation calls issued so far.
+unsigned long uniformLookupCount();
+
+#endif //GL_TEST_UNIFORM_CACHE_H
@@ -0,0 +1,311 @@
+//
+// Bounding volume hierarchy: binned SAH build, refit, culling and ray casts.
+//
+
+#include "bvh.h"
+
+#include <algorithm>
+
+// Centroid bins tried per axis when splitting a node
+static const uint32_t SAH_BINS = 16;
+
+void Aabb::grow(const glm::vec3 &point) {
+    lo = glm::min(lo, point);
+    hi = glm::max(hi, point);
+}
+
+void Aabb::grow(const Aabb &box) {
+    lo = glm::min(lo, box.lo);
+    hi = glm::max(hi, box.hi);
+}
+
+float Aabb::area() const {
+    glm::vec3 size = glm::max(hi - lo, glm::vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix) {
+    // Arvo: the new half size sums the absolute contributions of each axis
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(box.center(), 1.0f));
+    glm::vec3 half = 0.5f * (box.hi - box.lo);
+    glm::vec3 extent(0.0f);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++)
+            extent[row] += fabsf(matrix[column][row]) * half[column];
+    }
+    Aabb result;
+    result.lo = center - extent;
+    result.hi = center + extent;
+    return result;
+}
+
+bool intersectRayAabb(const Ray &ray, const glm::vec3 &inverse_direction, const Aabb &box, float max_t, float &t) {
+    glm::vec3 t0 = (box.lo - ray.origin) * inverse_direction;
+    glm::vec3 t1 = (box.hi - ray.origin) * inverse_direction;
+    glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+    float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), far.z);
+    if (entry > exit || entry >= max_t)
+        return false;
+    t = entry;
+    return true;
+}
+
+bool intersectRayTriangle(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, float &t) {
+    // Möller-Trumbore, both faces
+    glm::vec3 edge1 = v1 - v0, edge2 = v2 - v0;
+    glm::vec3 p = glm::cross(ray.direction, edge2);
+    float det = glm::dot(edge1, p);
+    if (fabsf(det) < 1e-12f)
+        return false;
+    float inv_det = 1.0f / det;
+    glm::vec3 s = ray.origin - v0;
+    float u = glm::dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(ray.direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(edge2, q) * inv_det;
+    return t >= 0.0f;
+}
+
+void Bvh::build(const std::vector<Aabb> &bounds) {
+    nodes.clear();
+    primitives.resize(bounds.size());
+    for (size_t i = 0; i < primitives.size(); i++)
+        primitives[i] = (uint32_t) i;
+
+    if (!bounds.empty()) {
+        std::vector<glm::vec3> centroids(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++)
+            centroids[i] = bounds[i].center();
+
+        nodes.reserve(2 * bounds.size());
+        primitive_bounds = bounds; // indexed by primitive while building
+        buildNode(0, (uint32_t) bounds.size(), centroids);
+    }
+    refit(bounds);
+}
+
+uint32_t Bvh::buildNode(uint32_t first, uint32_t count, const std::vector<glm::vec3> &centroids) {
+    uint32_t index = (uint32_t) nodes.size();
+    nodes.push_back(BvhNode());
+
+    Aabb box, centroid_box;
+    for (uint32_t i = first; i < first + count; i++) {
+        box.grow(primitive_bounds[primitives[i]]);
+        centroid_box.grow(centroids[primitives[i]]);
+    }
+    nodes[index].bounds = box;
+
+    // Best split between centroid bins: cost of the two children weighted
+    // by their area (the chance a ray or frustum reaching this node hits them)
+    int split_axis = -1;
+    uint32_t split_bin = 0;
+    float split_cost = INFINITY, split_lo = 0.0f, split_scale = 0.0f;
+    for (int axis = 0; axis < 3 && count > 1; axis++) {
+        float lo = centroid_box.lo[axis], extent = centroid_box.hi[axis] - lo;
+        if (!(extent > 0.0f))
+            continue;
+        float scale = SAH_BINS / extent;
+
+        Aabb bin_bounds[SAH_BINS];
+        uint32_t bin_counts[SAH_BINS] = {};
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t bin = std::min((uint32_t) ((centroids[primitives[i]][axis] - lo) * scale), SAH_BINS - 1);
+            bin_bounds[bin].grow(primitive_bounds[primitives[i]]);
+            bin_counts[bin]++;
+        }
+
+        // Right side of every split, then sweep the left side
+        float right_area[SAH_BINS];
+        uint32_t right_count[SAH_BINS];
+        Aabb side;
+        uint32_t side_count = 0;
+        for (uint32_t bin = SAH_BINS - 1; bin > 0; bin--) {
+            side.grow(bin_bounds[bin]);
+            side_count += bin_counts[bin];
+            right_area[bin - 1] = side.area();
+            right_count[bin - 1] = side_count;
+        }
+        side = Aabb();
+        side_count = 0;
+        for (uint32_t bin = 0; bin + 1 < SAH_BINS; bin++) {
+            side.grow(bin_bounds[bin]);
+            side_count += bin_counts[bin];
+            if (side_count == 0 || right_count[bin] == 0)
+                continue;
+            float cost = side_count * side.area() + right_count[bin] * right_area[bin];
+            if (cost < split_cost) {
+                split_axis = axis;
+                split_bin = bin;
+                split_cost = cost;
+                split_lo = lo;
+                split_scale = scale;
+            }
+        }
+    }
+
+    // A leaf costs a test per primitive, a split one node test plus its
+    // children (both relative to this node's area)
+    bool leaf = count == 1 ||
+                (count <= MAX_LEAF_SIZE && (split_axis < 0 || count * box.area() <= box.area() + split_cost));
+    if (leaf) {
+        nodes[index].first = first;
+        nodes[index].count = count;
+        return index;
+    }
+
+    uint32_t middle;
+    if (split_axis >= 0) {
+        auto begin = primitives.begin() + first;
+        middle = (uint32_t) (std::partition(begin, begin + count, [&](uint32_t primitive) {
+            float c = centroids[primitive][split_axis];
+            return std::min((uint32_t) ((c - split_lo) * split_scale), SAH_BINS - 1) <= split_bin;
+        }) - primitives.begin());
+    } else {
+        middle = first + count / 2; // coincident centroids
+    }
+
+    buildNode(first, middle - first, centroids);
+    uint32_t second = buildNode(middle, first + count - middle, centroids);
+    nodes[index].first = second;
+    nodes[index].count = 0;
+    return index;
+}
+
+void Bvh::refit(const std::vector<Aabb> &bounds) {
+    primitive_bounds.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); i++)
+        primitive_bounds[i] = bounds[primitives[i]];
+
+    // Children always come after their parent
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BvhNode &node = nodes[i];
+        Aabb box;
+        if (node.count > 0) {
+            for (uint32_t k = node.first; k < node.first + node.count; k++)
+                box.grow(primitive_bounds[k]);
+        } else {
+            box = nodes[i + 1].bounds;
+            box.grow(nodes[node.first].bounds);
+        }
+        node.bounds = box;
+    }
+}
+
+// False when the box is outside one of the planes of `planes` (bit mask);
+// clears the planes it is completely in front of
+static bool frustumTest(const Frustum &frustum, const Aabb &box, uint32_t &planes) {
+    for (int p = 0; p < 6; p++) {
+        if (!(planes & (1u << p)))
+            continue;
+        glm::vec3 normal(frustum.planes[p]);
+        float distance = frustum.planes[p].w;
+        glm::vec3 farthest(normal.x >= 0.0f ? box.hi.x : box.lo.x, normal.y >= 0.0f ? box.hi.y : box.lo.y,
+                           normal.z >= 0.0f ? box.hi.z : box.lo.z);
+        if (glm::dot(normal, farthest) + distance < 0.0f)
+            return false;
+        glm::vec3 nearest(normal.x >= 0.0f ? box.lo.x : box.hi.x, normal.y >= 0.0f ? box.lo.y : box.hi.y,
+                          normal.z >= 0.0f ? box.lo.z : box.hi.z);
+        if (glm::dot(normal, nearest) + distance >= 0.0f)
+            planes &= ~(1u << p);
+    }
+    return true;
+}
+
+void Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) const {
+    visible.clear();
+    if (nodes.empty())
+        return;
+
+    // Near children first, so the visible list is roughly front to back and
+    // the depth test rejects more of what is drawn later
+    const glm::vec4 &near_plane = frustum.planes[4];
+
+    struct Entry {
+        uint32_t node;
+        uint32_t planes; // planes the node's parent straddles
+    };
+    std::vector<Entry> stack;
+    stack.push_back({0, 0x3f});
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const BvhNode &node = nodes[entry.node];
+        if (!frustumTest(frustum, node.bounds, entry.planes))
+            continue;
+
+        if (node.count > 0) {
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                uint32_t planes = entry.planes;
+                if (frustumTest(frustum, primitive_bounds[k], planes))
+                    visible.push_back(primitives[k]);
+            }
+        } else {
+            uint32_t first = entry.node + 1, second = node.first;
+            float first_depth = glm::dot(glm::vec3(near_plane), nodes[first].bounds.center());
+            float second_depth = glm::dot(glm::vec3(near_plane), nodes[second].bounds.center());
+            if (first_depth < second_depth)
+                std::swap(first, second);
+            stack.push_back({first, entry.planes});
+            stack.push_back({second, entry.planes});
+        }
+    }
+}
+
+int64_t Bvh::intersect(const Ray &ray, float &t, RayPrimitiveFunc hit, void *user) const {
+    int64_t nearest = -1;
+    float nearest_t = INFINITY;
+    if (nodes.empty())
+        return nearest;
+    glm::vec3 inverse_direction = 1.0f / ray.direction;
+
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const BvhNode &node = nodes[stack.back()];
+        stack.pop_back();
+        float entry;
+        if (!intersectRayAabb(ray, inverse_direction, node.bounds, nearest_t, entry))
+            continue;
+
+        if (node.count > 0) {
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                float primitive_t;
+                if (!intersectRayAabb(ray, inverse_direction, primitive_bounds[k], nearest_t, primitive_t))
+                    continue;
+                if (hit && !hit(primitives[k], ray, primitive_t, user))
+                    continue;
+                if (primitive_t < nearest_t) {
+                    nearest_t = primitive_t;
+                    nearest = primitives[k];
+                }
+            }
+        } else {
+            // Nearest child on top, so it can shorten the ray for the other
+            uint32_t first = (uint32_t) (&node - nodes.data()) + 1, second = node.first;
+            float first_t = INFINITY, second_t = INFINITY;
+            intersectRayAabb(ray, inverse_direction, nodes[first].bounds, nearest_t, first_t);
+            intersectRayAabb(ray, inverse_direction, nodes[second].bounds, nearest_t, second_t);
+            if (first_t < second_t)
+                std::swap(first, second);
+            stack.push_back(first);
+            stack.push_back(second);
+        }
+    }
+
+    t = nearest_t;
+    return nearest;
+}
+
+float Bvh::sahCost() const {
+    if (nodes.empty() || nodes[0].bounds.area() <= 0.0f)
+        return 0.0f;
+    float cost = 0.0f;
+    for (const BvhNode &node : nodes)
+        cost += node.bounds.area() * (node.count > 0 ? node.count : 1);
+    return cost / nodes[0].bounds.area();
+}
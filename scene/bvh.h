@@ -0,0 +1,86 @@
+//
+// Bounding volume hierarchy over the instances of a scene: built once with
+// the surface area heuristic, refit every frame as the instances move, and
+// used for frustum culling and ray picking.
+//
+// Nodes live in one array in depth-first order: an inner node's first child
+// follows it and `first` holds its second child, so every node comes before
+// its children and a refit is a single backwards pass. The primitives of a
+// leaf are the range [first, first + count) of the leaf order.
+//
+
+#ifndef GL_TEST_BVH_H
+#define GL_TEST_BVH_H
+
+#include "culling.h"
+
+#include <glm/glm.hpp>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+struct Aabb {
+    glm::vec3 lo = glm::vec3(INFINITY);
+    glm::vec3 hi = glm::vec3(-INFINITY);
+
+    void grow(const glm::vec3 &point);
+    void grow(const Aabb &box);
+    glm::vec3 center() const { return 0.5f * (lo + hi); }
+    float area() const;
+};
+
+// Box holding `box` once transformed by `matrix` (affine)
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix);
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+// Distance along the ray (in units of its direction) to a box or a triangle
+bool intersectRayAabb(const Ray &ray, const glm::vec3 &inverse_direction, const Aabb &box, float max_t, float &t);
+bool intersectRayTriangle(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, float &t);
+
+struct BvhNode {
+    Aabb bounds;
+    uint32_t first; // leaf: first primitive in leaf order; inner node: second child
+    uint32_t count; // primitives of a leaf, 0 for inner nodes
+};
+
+// Exact test of primitive `primitive` once its box is hit: sets the distance
+// to the hit and returns true when the ray hits it
+typedef bool (*RayPrimitiveFunc)(uint32_t primitive, const Ray &ray, float &t, void *user);
+
+class Bvh {
+public:
+    static const uint32_t MAX_LEAF_SIZE = 4;
+
+    // Binned SAH build over the boxes of the primitives (their indices)
+    void build(const std::vector<Aabb> &bounds);
+    // New boxes for the same primitives, keeping the tree topology
+    void refit(const std::vector<Aabb> &bounds);
+
+    // Replaces `visible` with the primitives whose box intersects the
+    // frustum, nearest subtrees first. Planes a node is wholly in front of
+    // are not tested again below it.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+    // Nearest primitive hit by the ray, -1 when none is. Without `hit` the
+    // primitive's box counts as the primitive.
+    int64_t intersect(const Ray &ray, float &t, RayPrimitiveFunc hit = NULL, void *user = NULL) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t primitiveCount() const { return primitives.size(); }
+    // Expected box tests per ray against one per primitive: the SAH cost
+    // relative to the root's area (grows as refits loosen the tree)
+    float sahCost() const;
+
+private:
+    uint32_t buildNode(uint32_t first, uint32_t count, const std::vector<glm::vec3> &centroids);
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> primitives;  // primitive index of every leaf slot
+    std::vector<Aabb> primitive_bounds; // in leaf order
+};
+
+#endif //GL_TEST_BVH_H
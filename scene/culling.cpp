@@ -0,0 +1,85 @@
+//
+// Frustum culling of bounding spheres, 8 at a time.
+//
+
+#include "culling.h"
+#include "../raster/simd.h"
+
+#include <math.h>
+
+void BoundingSpheres::clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    count = 0;
+}
+
+void BoundingSpheres::add(const glm::vec3 &center, float r) {
+    // Fill the padding lanes as they are reached, keep 8 lanes past the end
+    if (count == x.size()) {
+        size_t padded = count + simd::WIDTH;
+        x.resize(padded, 0.0f);
+        y.resize(padded, 0.0f);
+        z.resize(padded, 0.0f);
+        radius.resize(padded, -INFINITY); // outside of every plane
+    }
+    x[count] = center.x;
+    y[count] = center.y;
+    z[count] = center.z;
+    radius[count] = r;
+    count++;
+}
+
+Frustum frustumFromMatrix(const glm::mat4 &m) {
+    // Rows of the matrix (glm is column-major: m[column][row])
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++)
+        rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+    // -w <= x, y, z <= w
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[2 * axis] = rows[3] + rows[axis];
+        frustum.planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+    for (glm::vec4 &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+float boundingRadius(const float *positions, int vertex_count) {
+    float radius = 0.0f;
+    for (int i = 0; i < vertex_count; i++)
+        radius = fmaxf(radius, glm::length(glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2])));
+    return radius;
+}
+
+void cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible) {
+    visible.clear();
+
+    vfloat plane_x[6], plane_y[6], plane_z[6], plane_d[6];
+    for (int p = 0; p < 6; p++) {
+        plane_x[p] = vfloat(frustum.planes[p].x);
+        plane_y[p] = vfloat(frustum.planes[p].y);
+        plane_z[p] = vfloat(frustum.planes[p].z);
+        plane_d[p] = vfloat(frustum.planes[p].w);
+    }
+
+    for (size_t i = 0; i < spheres.count; i += simd::WIDTH) {
+        vfloat x = vfloat::load(&spheres.x[i]), y = vfloat::load(&spheres.y[i]);
+        vfloat z = vfloat::load(&spheres.z[i]), r = vfloat::load(&spheres.radius[i]);
+        vfloat neg_r = -r;
+
+        // Outside as soon as the centre is further than r behind any plane
+        vmask inside;
+        for (int p = 0; p < 6; p++) {
+            vfloat distance = mulAdd(plane_x[p], x, mulAdd(plane_y[p], y, mulAdd(plane_z[p], z, plane_d[p])));
+            vmask in_front = distance >= neg_r;
+            inside = p == 0 ? in_front : inside & in_front;
+        }
+
+        for (int lanes = bits(inside); lanes; lanes &= lanes - 1)
+            visible.push_back((uint32_t) (i + __builtin_ctz(lanes)));
+    }
+}
@@ -0,0 +1,38 @@
+//
+// Frustum culling: bounding spheres stored as structure of arrays, tested
+// against the six planes of the view frustum 8 spheres at a time (simd.h).
+//
+
+#ifndef GL_TEST_CULLING_H
+#define GL_TEST_CULLING_H
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Arrays are padded to a multiple of 8 with empty spheres that never pass
+struct BoundingSpheres {
+    std::vector<float> x, y, z, radius;
+    size_t count = 0;
+
+    void clear();
+    void add(const glm::vec3 &center, float r);
+};
+
+// Planes as (normal, distance) with unit normals pointing inside, so
+// dot(normal, p) + distance is the signed distance of p
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Planes of the clip volume of `view_projection` (Gribb & Hartmann)
+Frustum frustumFromMatrix(const glm::mat4 &view_projection);
+
+// Radius of the sphere around the origin holding every vertex of a mesh
+float boundingRadius(const float *positions, int vertex_count);
+
+// Replaces `visible` with the indices of the spheres that intersect the
+// frustum, in increasing order.
+void cullSpheres(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible);
+
+#endif //GL_TEST_CULLING_H
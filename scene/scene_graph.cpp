@@ -0,0 +1,111 @@
+//
+// Scene graph in depth-first arrays with dirty-flag world transform updates.
+//
+
+#include "scene_graph.h"
+
+#include <stdio.h>
+
+static bool isIdentity(const Transforms &transforms, size_t i) {
+    return transforms.tx[i] == 0.0f && transforms.ty[i] == 0.0f && transforms.tz[i] == 0.0f &&
+           transforms.qx[i] == 0.0f && transforms.qy[i] == 0.0f && transforms.qz[i] == 0.0f &&
+           transforms.qw[i] == 1.0f && transforms.sx[i] == 1.0f && transforms.sy[i] == 1.0f &&
+           transforms.sz[i] == 1.0f;
+}
+
+void SceneGraph::clear() {
+    locals.clear();
+    parents.clear();
+    ends.clear();
+    flags.clear();
+    worlds.clear();
+}
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::vec3 &translation, const glm::quat &rotation,
+                             const glm::vec3 &scale) {
+    uint32_t node = (uint32_t) size();
+    if (parent != NO_PARENT && (parent >= node || ends[parent] != node)) {
+        fprintf(stderr, "ERROR: scene graph node %u added out of depth-first order\n", node);
+        return NO_PARENT;
+    }
+
+    locals.add(translation, rotation, scale);
+    parents.push_back(parent);
+    ends.push_back(node + 1);
+    flags.push_back(0);
+    worlds.push_back(InstanceData());
+    for (uint32_t ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+        ends[ancestor] = node + 1;
+    markDirty(node);
+    return node;
+}
+
+void SceneGraph::setTranslation(uint32_t node, const glm::vec3 &translation) {
+    locals.setTranslation(node, translation);
+    markDirty(node);
+}
+
+void SceneGraph::setRotation(uint32_t node, const glm::quat &rotation) {
+    locals.setRotation(node, rotation);
+    markDirty(node);
+}
+
+void SceneGraph::markDirty(uint32_t node) {
+    flags[node] |= DIRTY;
+    if (isIdentity(locals, node))
+        flags[node] |= LOCAL_IDENTITY;
+    else
+        flags[node] &= ~LOCAL_IDENTITY;
+
+    // Ancestors already flagged have theirs flagged too
+    for (uint32_t ancestor = parents[node]; ancestor != NO_PARENT && !(flags[ancestor] & DIRTY_BELOW);
+         ancestor = parents[ancestor])
+        flags[ancestor] |= DIRTY_BELOW;
+}
+
+size_t SceneGraph::update() {
+    // Dirty subtrees next to each other (siblings, typically) are computed
+    // as one range, so the SIMD batches stay full
+    size_t updated = 0;
+    uint32_t range_first = 0, range_end = 0;
+    uint32_t node = 0;
+    while (node < size()) {
+        if (flags[node] & DIRTY) {
+            if (node != range_end) {
+                updateRange(range_first, range_end);
+                range_first = node;
+            }
+            range_end = ends[node];
+            updated += ends[node] - node;
+            node = ends[node];
+        } else if (flags[node] & DIRTY_BELOW) {
+            flags[node] &= ~DIRTY_BELOW;
+            node++;
+        } else {
+            node = ends[node];
+        }
+    }
+    updateRange(range_first, range_end);
+    return updated;
+}
+
+void SceneGraph::updateRange(uint32_t first, uint32_t end) {
+    if (first == end)
+        return;
+
+    // Local matrices of the whole range in SIMD batches, then parents
+    // (earlier in the range, or outside and clean) applied in order
+    computeInstanceMatrices(locals, (size_t) first, (size_t) (end - first), &worlds[first]);
+    for (uint32_t i = first; i < end; i++) {
+        uint32_t parent = parents[i];
+        bool parent_identity = parent == NO_PARENT || (flags[parent] & WORLD_IDENTITY);
+        if (!parent_identity) {
+            worlds[i].model = worlds[parent].model * worlds[i].model;
+            worlds[i].normal_to_world = worlds[parent].normal_to_world * worlds[i].normal_to_world;
+        }
+
+        flags[i] &= ~(DIRTY | DIRTY_BELOW | WORLD_IDENTITY);
+        if (parent_identity && (flags[i] & LOCAL_IDENTITY))
+            flags[i] |= WORLD_IDENTITY;
+    }
+}
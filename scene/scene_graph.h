@@ -0,0 +1,66 @@
+//
+// Scene graph: every node owns a local transform and its world transform is
+// its parent's world transform times the local one.
+//
+// Nodes are stored depth first in flat arrays, so a subtree is a contiguous
+// range [node, end) and parents always come before their children. Setting
+// a local transform marks the node dirty and its ancestors as having dirty
+// nodes below; update() recomputes dirty subtrees only and jumps over clean
+// ones whole, so static geometry costs nothing per frame.
+//
+
+#ifndef GL_TEST_SCENE_GRAPH_H
+#define GL_TEST_SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "transforms.h"
+#include "../render/instancing.h"
+
+class SceneGraph {
+public:
+    static const uint32_t NO_PARENT = 0xffffffffu;
+
+    void clear();
+
+    // Nodes must be added depth first: `parent` is the last node added or
+    // one of its ancestors, or NO_PARENT for a new root. Returns the node,
+    // or NO_PARENT (with an error) when the order is broken.
+    uint32_t addNode(uint32_t parent, const glm::vec3 &translation, const glm::quat &rotation = glm::quat(),
+                     const glm::vec3 &scale = glm::vec3(1.0f));
+
+    void setTranslation(uint32_t node, const glm::vec3 &translation);
+    void setRotation(uint32_t node, const glm::quat &rotation);
+
+    // Recomputes the world transforms of the dirty subtrees, returning how
+    // many nodes were recomputed
+    size_t update();
+
+    size_t size() const { return parents.size(); }
+    uint32_t parent(uint32_t node) const { return parents[node]; }
+    // World model and normal matrices, as of the last update()
+    const InstanceData &world(uint32_t node) const { return worlds[node]; }
+
+private:
+    enum Flags {
+        DIRTY = 1,          // local transform changed
+        DIRTY_BELOW = 2,    // some descendant is dirty
+        LOCAL_IDENTITY = 4, // local transform is the identity
+        WORLD_IDENTITY = 8  // so is the world transform
+    };
+
+    void markDirty(uint32_t node);
+    // Recomputes the nodes [first, end), whole subtrees
+    void updateRange(uint32_t first, uint32_t end);
+
+    Transforms locals;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> ends; // one past the last node of each subtree
+    std::vector<uint8_t> flags;
+    std::vector<InstanceData> worlds;
+};
+
+#endif //GL_TEST_SCENE_GRAPH_H
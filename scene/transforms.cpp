@@ -0,0 +1,96 @@
+//
+// Structure of arrays transforms and batched instance matrices.
+//
+
+#include "transforms.h"
+#include "../raster/simd.h"
+
+#include <algorithm>
+
+void Transforms::clear() {
+    for (std::vector<float> *array : {&tx, &ty, &tz, &qx, &qy, &qz, &qw, &sx, &sy, &sz})
+        array->clear();
+}
+
+size_t Transforms::add(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+    tx.push_back(translation.x);
+    ty.push_back(translation.y);
+    tz.push_back(translation.z);
+    qx.push_back(rotation.x);
+    qy.push_back(rotation.y);
+    qz.push_back(rotation.z);
+    qw.push_back(rotation.w);
+    sx.push_back(scale.x);
+    sy.push_back(scale.y);
+    sz.push_back(scale.z);
+    return tx.size() - 1;
+}
+
+void Transforms::setTranslation(size_t i, const glm::vec3 &translation) {
+    tx[i] = translation.x;
+    ty[i] = translation.y;
+    tz[i] = translation.z;
+}
+
+void Transforms::setRotation(size_t i, const glm::quat &rotation) {
+    qx[i] = rotation.x;
+    qy[i] = rotation.y;
+    qz[i] = rotation.z;
+    qw[i] = rotation.w;
+}
+
+void computeInstanceMatrices(const Transforms &transforms, size_t first, size_t count, InstanceData *out) {
+    const std::vector<float> *arrays[10] = {&transforms.tx, &transforms.ty, &transforms.tz, &transforms.qx,
+                                            &transforms.qy, &transforms.qz, &transforms.qw, &transforms.sx,
+                                            &transforms.sy, &transforms.sz};
+
+    for (size_t base = 0; base < count; base += simd::WIDTH) {
+        size_t lanes = std::min(count - base, (size_t) simd::WIDTH);
+
+        // Gather the batch, repeating the last object in unused lanes
+        float in[10][simd::WIDTH];
+        for (int lane = 0; lane < simd::WIDTH; lane++) {
+            size_t i = base + std::min((size_t) lane, lanes - 1);
+            for (int a = 0; a < 10; a++)
+                in[a][lane] = (*arrays[a])[first + i];
+        }
+        vfloat x = vfloat::load(in[3]), y = vfloat::load(in[4]), z = vfloat::load(in[5]), w = vfloat::load(in[6]);
+        vfloat scale[3] = {vfloat::load(in[7]), vfloat::load(in[8]), vfloat::load(in[9])};
+
+        // Rotation matrix of the unit quaternion, columns r[c][row]
+        vfloat one(1.0f), two(2.0f);
+        vfloat xx = x * x, yy = y * y, zz = z * z, xy = x * y, xz = x * z, yz = y * z;
+        vfloat wx = w * x, wy = w * y, wz = w * z;
+        vfloat r[3][3] = {
+                {one - two * (yy + zz), two * (xy + wz), two * (xz - wy)},
+                {two * (xy - wz), one - two * (xx + zz), two * (yz + wx)},
+                {two * (xz + wy), two * (yz - wx), one - two * (xx + yy)},
+        };
+
+        float model[3][3][simd::WIDTH], normal[3][3][simd::WIDTH];
+        for (int c = 0; c < 3; c++) {
+            for (int row = 0; row < 3; row++)
+                (r[c][row] * scale[c]).store(model[c][row]);
+        }
+
+        // Uniform positive scale: the rotation alone, normalized in the
+        // shaders. A mirroring one keeps R * S^-1, whose sign the normals need.
+        vmask uniform = (scale[0] <= scale[1]) & (scale[1] <= scale[0]) & (scale[1] <= scale[2]) &
+                        (scale[2] <= scale[1]) & (scale[0] > vfloat(0.0f));
+        bool all_uniform = bits(uniform) == (1 << simd::WIDTH) - 1;
+        for (int c = 0; c < 3; c++) {
+            vfloat inverse_scale = all_uniform ? one : select(uniform, one, one / scale[c]);
+            for (int row = 0; row < 3; row++)
+                (r[c][row] * inverse_scale).store(normal[c][row]);
+        }
+
+        for (size_t lane = 0; lane < lanes; lane++) {
+            InstanceData &data = out[base + lane];
+            for (int c = 0; c < 3; c++) {
+                data.model[c] = glm::vec4(model[c][0][lane], model[c][1][lane], model[c][2][lane], 0.0f);
+                data.normal_to_world[c] = glm::vec3(normal[c][0][lane], normal[c][1][lane], normal[c][2][lane]);
+            }
+            data.model[3] = glm::vec4(in[0][lane], in[1][lane], in[2][lane], 1.0f);
+        }
+    }
+}
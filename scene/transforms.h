@@ -0,0 +1,40 @@
+//
+// Object transforms as structure of arrays: translation, rotation (unit
+// quaternion) and scale of every object in separate float arrays, turned
+// into instance matrices 8 objects at a time (simd.h).
+//
+
+#ifndef GL_TEST_TRANSFORMS_H
+#define GL_TEST_TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "../render/instancing.h"
+
+struct Transforms {
+    std::vector<float> tx, ty, tz;     // translation
+    std::vector<float> qx, qy, qz, qw; // rotation
+    std::vector<float> sx, sy, sz;     // scale
+
+    size_t size() const { return tx.size(); }
+    void clear();
+    // Appends an object, returning its index
+    size_t add(const glm::vec3 &translation, const glm::quat &rotation = glm::quat(),
+               const glm::vec3 &scale = glm::vec3(1.0f));
+
+    glm::vec3 translation(size_t i) const { return glm::vec3(tx[i], ty[i], tz[i]); }
+    glm::quat rotation(size_t i) const { return glm::quat(qw[i], qx[i], qy[i], qz[i]); }
+    void setTranslation(size_t i, const glm::vec3 &translation);
+    void setRotation(size_t i, const glm::quat &rotation);
+};
+
+// Model and normal matrices of the objects `first` to `first + count - 1`
+// into `out`. The normal matrix of a TRS transform is R * S^-1, never a full
+// inverse, and just R when the scale is uniform and positive (the shaders
+// normalize normals).
+void computeInstanceMatrices(const Transforms &transforms, size_t first, size_t count, InstanceData *out);
+
+#endif //GL_TEST_TRANSFORMS_H
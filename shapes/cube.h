@@ -8,6 +8,10 @@
 #include <GL/glew.h>
 
 class Cube {
+public:
+    static const int VERTEX_COUNT = 24;
+    static const int INDEX_COUNT = 36;
+
 private:
     // Cube to be rendered
     //
@@ -18,155 +22,114 @@ private:
     // far ---> 1        2
     //       6        5
     //
+    // Every corner is shared by three faces with different normals and
+    // texture coordinates, so each face keeps its own 4 vertices (24 in
+    // total) and the 12 triangles index into them.
 
-    GLfloat vertex[108] =  {
+    GLfloat vertex[VERTEX_COUNT * 3] =  {
             -0.25f, -0.25f, -0.25f, // 1
             -0.25f,  0.25f, -0.25f, // 0
-            0.25f, -0.25f, -0.25f, // 2
-
-            0.25f,  0.25f, -0.25f, // 3
-            0.25f, -0.25f, -0.25f, // 2
-            -0.25f,  0.25f, -0.25f, // 0
-
-            0.25f, -0.25f, -0.25f, // 2
-            0.25f,  0.25f, -0.25f, // 3
-            0.25f, -0.25f,  0.25f, // 5
+             0.25f, -0.25f, -0.25f, // 2
+             0.25f,  0.25f, -0.25f, // 3
 
-            0.25f,  0.25f,  0.25f, // 4
-            0.25f, -0.25f,  0.25f, // 5
-            0.25f,  0.25f, -0.25f, // 3
+             0.25f, -0.25f, -0.25f, // 2
+             0.25f,  0.25f, -0.25f, // 3
+             0.25f, -0.25f,  0.25f, // 5
+             0.25f,  0.25f,  0.25f, // 4
 
-            0.25f, -0.25f,  0.25f, // 5
-            0.25f,  0.25f,  0.25f, // 4
+             0.25f, -0.25f,  0.25f, // 5
+             0.25f,  0.25f,  0.25f, // 4
             -0.25f, -0.25f,  0.25f, // 6
-
             -0.25f,  0.25f,  0.25f, // 7
-            -0.25f, -0.25f,  0.25f, // 6
-            0.25f,  0.25f,  0.25f, // 4
 
             -0.25f, -0.25f,  0.25f, // 6
             -0.25f,  0.25f,  0.25f, // 7
             -0.25f, -0.25f, -0.25f, // 1
-
             -0.25f,  0.25f, -0.25f, // 0
-            -0.25f, -0.25f, -0.25f, // 1
-            -0.25f,  0.25f,  0.25f, // 7
 
-            0.25f, -0.25f, -0.25f, // 2
-            0.25f, -0.25f,  0.25f, // 5
+             0.25f, -0.25f, -0.25f, // 2
+             0.25f, -0.25f,  0.25f, // 5
             -0.25f, -0.25f, -0.25f, // 1
-
             -0.25f, -0.25f,  0.25f, // 6
-            -0.25f, -0.25f, -0.25f, // 1
-            0.25f, -0.25f,  0.25f, // 5
-
-            0.25f,  0.25f,  0.25f, // 4
-            0.25f,  0.25f, -0.25f, // 3
-            -0.25f,  0.25f,  0.25f, // 7
 
-            -0.25f,  0.25f, -0.25f, // 0
+             0.25f,  0.25f,  0.25f, // 4
+             0.25f,  0.25f, -0.25f, // 3
             -0.25f,  0.25f,  0.25f, // 7
-            0.25f,  0.25f, -0.25f  // 3
+            -0.25f,  0.25f, -0.25f  // 0
     };
 
-    GLfloat vertex_normals[108]= {
-            0.0f,  0.0f, -1.0f, // 1
-            0.0f,  0.0f, -1.0f, // 0
-            0.0f,  0.0f, -1.0f, // 2
-
-            0.0f,  0.0f, -1.0f, // 3
-            0.0f,  0.0f, -1.0f, // 2
-            0.0f,  0.0f, -1.0f, // 0
-
-            1.0f,  0.0f,  0.0f, // 2
-            1.0f,  0.0f,  0.0f, // 3
-            1.0f,  0.0f,  0.0f, // 5
+    GLfloat vertex_normals[VERTEX_COUNT * 3]= {
+             0.0f,  0.0f, -1.0f, // 1
+             0.0f,  0.0f, -1.0f, // 0
+             0.0f,  0.0f, -1.0f, // 2
+             0.0f,  0.0f, -1.0f, // 3
 
-            1.0f,  0.0f,  0.0f, // 4
-            1.0f,  0.0f,  0.0f, // 5
-            1.0f,  0.0f,  0.0f, // 3
+             1.0f,  0.0f,  0.0f, // 2
+             1.0f,  0.0f,  0.0f, // 3
+             1.0f,  0.0f,  0.0f, // 5
+             1.0f,  0.0f,  0.0f, // 4
 
-            0.0f,  0.0f,  1.0f, // 5
-            0.0f,  0.0f,  1.0f, // 4
-            0.0f,  0.0f,  1.0f, // 6
-
-            0.0f,  0.0f,  1.0f, // 7
-            0.0f,  0.0f,  1.0f, // 6
-            0.0f,  0.0f,  1.0f, // 4
+             0.0f,  0.0f,  1.0f, // 5
+             0.0f,  0.0f,  1.0f, // 4
+             0.0f,  0.0f,  1.0f, // 6
+             0.0f,  0.0f,  1.0f, // 7
 
             -1.0f,  0.0f,  0.0f, // 6
             -1.0f,  0.0f,  0.0f, // 7
             -1.0f,  0.0f,  0.0f, // 1
-
             -1.0f,  0.0f,  0.0f, // 0
-            -1.0f,  0.0f,  0.0f, // 1
-            -1.0f,  0.0f,  0.0f, // 7
-
-            0.0f, -1.0f,  0.0f, // 2
-            0.0f, -1.0f,  0.0f, // 5
-            0.0f, -1.0f,  0.0f, // 1
 
-            0.0f, -1.0f,  0.0f, // 6
-            0.0f, -1.0f,  0.0f, // 1
-            0.0f, -1.0f,  0.0f, // 5
+             0.0f, -1.0f,  0.0f, // 2
+             0.0f, -1.0f,  0.0f, // 5
+             0.0f, -1.0f,  0.0f, // 1
+             0.0f, -1.0f,  0.0f, // 6
 
-            0.0f,  1.0f,  0.0f, // 4
-            0.0f,  1.0f,  0.0f, // 3
-            0.0f,  1.0f,  0.0f, // 7
-
-            0.0f,  1.0f,  0.0f, // 0
-            0.0f,  1.0f,  0.0f, // 7
-            0.0f,  1.0f,  0.0f  // 3
+             0.0f,  1.0f,  0.0f, // 4
+             0.0f,  1.0f,  0.0f, // 3
+             0.0f,  1.0f,  0.0f, // 7
+             0.0f,  1.0f,  0.0f  // 0
     };
 
-    GLfloat uv_texture[72] = {
+    GLfloat uv_texture[VERTEX_COUNT * 2] = {
             1.0f, 0.0f, // 1
             1.0f, 1.0f, // 0
             0.0f, 0.0f, // 2
-
             0.0f, 1.0f, // 3
-            0.0f, 0.0f, // 2
-            1.0f, 1.0f, // 0
 
             1.0f, 0.0f, // 2
             1.0f, 1.0f, // 3
             0.0f, 0.0f, // 5
-
             0.0f, 1.0f, // 4
-            0.0f, 0.0f, // 5
-            1.0f, 1.0f, // 3
 
             1.0f, 0.0f, // 5
             1.0f, 1.0f, // 4
             0.0f, 0.0f, // 6
-
             0.0f, 1.0f, // 7
-            0.0f, 0.0f, // 6
-            1.0f, 1.0f, // 4
 
             1.0f, 0.0f, // 6
             1.0f, 1.0f, // 7
             0.0f, 0.0f, // 1
-
             0.0f, 1.0f, // 0
-            0.0f, 0.0f, // 1
-            1.0f, 1.0f, // 7
 
             0.0f, 1.0f, // 2
             0.0f, 0.0f, // 5
             1.0f, 1.0f, // 1
-
             1.0f, 0.0f, // 6
-            1.0f, 1.0f, // 1
-            0.0f, 0.0f, // 5
 
             1.0f, 0.0f, // 4
             1.0f, 1.0f, // 3
             0.0f, 0.0f, // 7
+            0.0f, 1.0f  // 0
+    };
 
-            0.0f, 1.0f, // 0
-            0.0f, 0.0f, // 7
-            1.0f, 1.0f  // 3
+    // Two triangles per face
+    GLushort indices[INDEX_COUNT] = {
+             0,  1,  2,   3,  2,  1,
+             4,  5,  6,   7,  6,  5,
+             8,  9, 10,  11, 10,  9,
+            12, 13, 14,  15, 14, 13,
+            16, 17, 18,  19, 18, 17,
+            20, 21, 22,  23, 22, 21
     };
 
 
@@ -183,6 +146,10 @@ public:
     GLfloat* getUV() {
         return uv_texture;
     }
+
+    GLushort* getIndices() {
+        return indices;
+    }
 };
 
 #endif //GL_TEST_CUBE_H
\ No newline at end of file
@@ -8,6 +8,10 @@
 #include <GL/glew.h>
 
 class Tetrahedron {
+public:
+    static const int VERTEX_COUNT = 12;
+    static const int INDEX_COUNT = 12;
+
 private:
     // Tetrahedron to be rendered
     //
@@ -18,44 +22,46 @@ private:
     // far ---> 1
     //                5
     //
+    // Flat shaded: every face has its own normal, so no vertex can be shared
+    // between faces and the index buffer is the identity.
 
-    GLfloat vertex[36] =  {
+    GLfloat vertex[VERTEX_COUNT * 3] =  {
             -0.25f, -0.25f, -0.25f, // 1
             -0.25f,  0.25f,  0.25f, // 7
-            0.25f, -0.25f,  0.25f, // 5
+             0.25f, -0.25f,  0.25f, // 5
 
             -0.25f,  0.25f,  0.25f, // 7
-            0.25f, -0.25f,  0.25f, // 5
-            0.25f,  0.25f, -0.25f, // 3
+             0.25f, -0.25f,  0.25f, // 5
+             0.25f,  0.25f, -0.25f, // 3
 
             -0.25f,  0.25f,  0.25f, // 7
-            0.25f,  0.25f, -0.25f, // 3
+             0.25f,  0.25f, -0.25f, // 3
             -0.25f, -0.25f, -0.25f, // 1
 
-            0.25f,  0.25f, -0.25f, // 3
+             0.25f,  0.25f, -0.25f, // 3
             -0.25f, -0.25f, -0.25f, // 1
-            0.25f, -0.25f,  0.25f, // 5
+             0.25f, -0.25f,  0.25f  // 5
     };
 
-    GLfloat vertex_normal[36] = {
+    GLfloat vertex_normal[VERTEX_COUNT * 3] = {
             -1.f, -1.f,  1.f, // 1
             -1.f, -1.f,  1.f, // 7
             -1.f, -1.f,  1.f, // 5
 
-            1.f, 1.f,  1.f, // 7
-            1.f, 1.f,  1.f, // 5
-            1.f, 1.f,  1.f, // 3
+             1.f,  1.f,  1.f, // 7
+             1.f,  1.f,  1.f, // 5
+             1.f,  1.f,  1.f, // 3
 
-            -1.f, 1.f,  -1.f, // 7
-            -1.f, 1.f,  -1.f, // 3
-            -1.f, 1.f,  -1.f, // 1
+            -1.f,  1.f, -1.f, // 7
+            -1.f,  1.f, -1.f, // 3
+            -1.f,  1.f, -1.f, // 1
 
-            1.f, -1.f,  -1.f, // 3
-            1.f, -1.f,  -1.f, // 1
-            1.f, -1.f,  -1.f, // 5
+             1.f, -1.f, -1.f, // 3
+             1.f, -1.f, -1.f, // 1
+             1.f, -1.f, -1.f // 5
     };
 
-    GLfloat uv_texture[24] = {
+    GLfloat uv_texture[VERTEX_COUNT * 2] = {
             0.f, 0.f, // 1
             0.f, 1.f, // 7
             1.f, 0.f, // 5
@@ -70,7 +76,14 @@ private:
 
             1.f, 1.f, // 3
             0.f, 0.f, // 1
-            1.f, 0.f, // 5
+            1.f, 0.f  // 5
+    };
+
+    GLushort indices[INDEX_COUNT] = {
+             0,  1,  2,
+             3,  4,  5,
+             6,  7,  8,
+             9, 10, 11
     };
 
 public:
@@ -86,6 +99,10 @@ public:
     GLfloat* getUVs() {
         return uv_texture;
     }
+
+    GLushort* getIndices() {
+        return indices;
+    }
 };
 
 #endif //GL_TEST_TETRAHEDRON_H
\ No newline at end of file
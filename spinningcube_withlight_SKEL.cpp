@@ -5,6 +5,8 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // GLM library to deal with matrix operations
 #include <glm/glm.hpp>
@@ -12,12 +14,40 @@
 #include <glm/gtc/matrix_transform.hpp> // glm::translate, glm::rotate, glm::perspective
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <chrono>
+#include <math.h>
+#include <vector>
 
 #include "textfile/textfile_ALT.h"
 #include "shapes/cube.h"
 #include "shapes/tetrahedron.h"
+#include "bench/benchmark.h"
+#include "render/uniform_cache.h"
+#include "render/uniform_blocks.h"
+#include "render/mesh.h"
+#include "render/instancing.h"
+#include "render/texture_loader.h"
+#include "render/shader.h"
+#include "render/shader_variants.h"
+#include "render/texture_cache.h"
+#include "render/clustered_lighting.h"
+#include "render/gbuffer.h"
+#include "render/gpu_timer.h"
+#include "render/render_state.h"
+#include "render/render_queue.h"
+#include "render/mesh_pool.h"
+#include "render/multi_draw.h"
+#include "render/ring_buffer.h"
+#include "raster/rasterizer.h"
+#include "raster/tiled_rasterizer.h"
+#include "scene/culling.h"
+#include "scene/bvh.h"
+#include "scene/scene_graph.h"
+#include "util/profiler.h"
+#ifdef PHONG_HEADLESS
+#include "render/headless.h"
+#endif
 
-#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 int gl_width = 640;
@@ -26,24 +56,125 @@ int gl_height = 480;
 void glfw_window_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 void render(double);
-unsigned int loadTexture(char const * path);
-
-
-GLuint shader_program = 0; // shader program to set render pipeline
-GLuint vao = 0; // Vertext Array Object to set input data
-GLuint tetraVAO;
-
-GLint model_location, view_location, proj_location; // Uniforms for transformation matrices
-GLint normal_matrix_location; // Uniform for normal matrix
+void createScene();
+void createLights();
+void updateInstances(float f, const glm::mat4 &view_projection);
+void packInstances(const std::vector<uint32_t> &nodes, const std::vector<uint32_t> &visible, InstanceData *out);
+float nearestInstanceDepth(const std::vector<uint32_t> &nodes, const std::vector<uint32_t> &visible);
+GLsizeiptr ringFrameSize();
+void poolDraw(DrawItem &item, uint32_t mesh, GLuint first_instance, GLsizei instance_count, GLint first_layer);
+glm::quat cubeRotation(float f);
+glm::quat tetrahedronRotation(float f);
+size_t animateScene(float f);
+void instanceBoxes(const Aabb &mesh_box, const std::vector<uint32_t> &nodes, std::vector<Aabb> &boxes);
+void refitBvhs();
+void pickInstance(double x, double y, float f);
+void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+bool parseArguments(int argc, char **argv);
+bool runBenchmark(GLFWwindow *window);
+bool runCpuRenderer();
+bool writeTrace();
+CameraBlock cameraBlock();
+LightsBlock lightsBlock();
+void bindProgramAttributes(GLuint program);
+void bindGBufferProgramAttributes(GLuint program);
+void initSceneProgram(GLuint program, const ShaderVariantKey &key);
+ShaderVariantKey sceneVariant(bool textured);
+GLuint outputFramebuffer();
+void beginGpuPass(const char *name);
+
+
+// Shader programs to set render pipeline: one variant per combination of
+// lights and textures the draws need (sceneVariant())
+ShaderVariants *scene_shaders = NULL;
+Mesh cube_mesh, tetrahedron_mesh; // Vertex Array Objects (and buffers) to set input data
+VertexLayout vertex_layout = VERTEX_LAYOUT_INTERLEAVED;
+
+// Scene: every cube and tetrahedron is an instance of its mesh, so each mesh
+// takes one draw call no matter how many objects there are
+int instance_count = 1; // objects per mesh
+
+// Scene graph: a root with a group node per mesh whose children are its
+// instances (cube_nodes[i] is the node of cube i). Only the nodes of the
+// meshes that spin are touched every frame.
+SceneGraph scene_graph;
+std::vector<uint32_t> cube_nodes, tetrahedron_nodes;
+bool cube_animated = true, tetrahedron_animated = true;
+std::vector<InstanceData> cube_instances, tetrahedron_instances;
+InstanceBuffer cube_instance_buffer, tetrahedron_instance_buffer;
+// This frame's draws, sorted by program, textures, mesh and then depth
+RenderQueue render_queue;
+
+// Indirect submission: both meshes live in one mesh pool with one shared
+// instance buffer and their maps in one texture array (layers: cube
+// diffuse, cube specular, tetrahedron diffuse, tetrahedron specular), so a
+// single glMultiDrawElementsIndirect draws the whole scene. Direct
+// submission draws each mesh from its own vertex array.
+enum Submission { SUBMISSION_DIRECT, SUBMISSION_INDIRECT };
+Submission submission = SUBMISSION_INDIRECT;
+MeshPool mesh_pool;
+uint32_t cube_pool_mesh = 0, tetrahedron_pool_mesh = 0;
+InstanceBuffer pool_instance_buffer;
+GLuint material_maps = 0;
+MultiDraw multi_draw;
+
+// Frustum culling: only instances whose bounds intersect the view frustum
+// are drawn. The BVHs (one per mesh, also used to pick) are refit to the
+// instances' world boxes every frame their mesh spins; linear culling tests
+// every bounding sphere, which holds under any rotation.
+enum CullingMode { CULLING_OFF, CULLING_LINEAR, CULLING_BVH };
+CullingMode culling = CULLING_BVH;
+BoundingSpheres cube_bounds, tetrahedron_bounds;
+Bvh cube_bvh, tetrahedron_bvh;
+Aabb cube_mesh_box, tetrahedron_mesh_box; // object space
+std::vector<Aabb> instance_boxes;
+std::vector<uint32_t> cube_visible, tetrahedron_visible;
+double bvh_build_ms = 0.0;
+
+// Scene update and culling work summed over frames, reset by the benchmark
+struct SceneStats {
+    unsigned long long frames = 0;
+    unsigned long long tested = 0, visible = 0; // instances
+    unsigned long long nodes_updated = 0;        // scene graph
+    unsigned long long draw_calls = 0;
+    double graph_ms = 0.0, refit_ms = 0.0, cull_ms = 0.0;
+};
+SceneStats scene_stats;
+
+// Window pixel to pick in headless mode (--pick), negative: none
+double pick_x = -1.0, pick_y = -1.0;
+
+// Uniform buffers for per-frame data (view/projection/camera and lights)
+GLuint camera_ubo = 0, lights_ubo = 0;
+
+// Streaming of per-frame data (uniform blocks, instances, multi-draw
+// commands): written in place into a persistently mapped ring buffer of
+// three fenced frames, or uploaded to buffers orphaned every frame
+enum Streaming { STREAMING_ORPHAN, STREAMING_RING };
+Streaming streaming = STREAMING_RING;
+int ring_frames = 3; // regions, frames the CPU may write ahead of the GPU
+RingBuffer frame_ring;
+
+// glGetUniformLocation calls issued during startup, any later one is reported
+unsigned long startup_uniform_lookups = 0;
 
 // Shader names
 const char *vertexFileName = "../spinningcube_withlight_vs_SKEL.glsl";
 const char *fragmentFileName = "../spinningcube_withlight_fs_SKEL.glsl";
+const char *clusteredFragmentFileName = "../spinningcube_withlight_clustered_fs.glsl";
+const char *gbufferFragmentFileName = "../spinningcube_withlight_gbuffer_fs.glsl";
+const char *deferredVertexFileName = "../spinningcube_withlight_deferred_vs.glsl";
+const char *deferredFragmentFileName = "../spinningcube_withlight_deferred_fs.glsl";
+
+// Linked program binaries are cached here between runs (NULL: disabled)
+const char *shader_cache_dir = "shader_cache";
 
 // Camera
 glm::vec3 camera_pos(0.0f, 0.0f, 3.0f);
 glm::vec3 camera_front(0.0f, 0.0f, -1.0f);
 glm::vec3 camera_up(0.0f, 1.0f, 0.0f);
+const float camera_fov_y = glm::radians(50.0f);
+const float camera_near = 0.1f, camera_far = 100.0f;
 
 // Lighting
 glm::vec3 light_pos(-1.0f, 0.0f, 0.0f);
@@ -51,6 +182,27 @@ glm::vec3 light_pos_2(1.f, 0.0f, 1.0f);
 glm::vec3 light_ambient(0.2f, 0.2f, 0.2f);
 glm::vec3 light_diffuse(0.5f, 0.5f, 0.5f);
 glm::vec3 light_specular(1.0f, 1.0f, 1.0f);
+int main_light_count = NR_POINT_LIGHTS; // the first n of the lights above
+
+// Clustered lighting: with extra point lights (--lights) the fragment shader
+// only evaluates the lights of each fragment's cluster
+int light_count = 0;
+std::vector<PointLight> point_lights;
+ClusteredLighting clustered_lighting;
+
+// Deferred shading: the scene shaders fill the G-buffer and lighting_program
+// shades each pixel once, always with clustered lighting
+enum ShadingMode { SHADING_FORWARD, SHADING_DEFERRED };
+ShadingMode shading = SHADING_FORWARD;
+GBuffer gbuffer;
+GLuint lighting_program = 0;
+GLint lighting_shininess_location;
+
+// When set, counts the fragments of the scene draws that pass the depth test
+GLuint fragment_query = 0;
+
+// When set, times every pass of render() on the GPU (benchmark mode)
+GpuPassTimer *pass_timer = NULL;
 
 // Material
 glm::vec3 material_ambient(1.0f, 0.5f, 0.31f);
@@ -58,37 +210,104 @@ glm::vec3 material_diffuse(1.0f, 0.5f, 0.31f);
 glm::vec3 material_specular(0.5f, 0.5f, 0.5f);
 const GLfloat material_shininess = 32.0f;
 
+// Untextured meshes are drawn with the flat material colours above
+bool cube_textured = true, tetrahedron_textured = true;
+
+// Diffuse and specular maps of the cube and the tetrahedron
+const std::vector<std::string> texture_paths = {
+    "../etc/m2base.jpg", "../etc/m2metall.jpg", "../etc/mdbase.jpg", "../etc/mdmetall.jpg"
+};
 unsigned int diffuseMapCube, diffuseMapTetr, specularMapCube, specularMapTetr;
 
-int main() {
-    // start GL context and O/S window using the GLFW helper library
-    if (!glfwInit()) {
-        fprintf(stderr, "ERROR: could not start GLFW3\n");
+// Decoded, mipmapped textures are cached here between runs (NULL: disabled)
+const char *texture_cache_dir = "texture_cache";
+
+// Headless mode: render offscreen into an FBO, no window system needed
+bool headless = false;
+int headless_frames = 1; // frames rendered before the last one is saved
+const char *headless_output = "frame.ppm";
+
+// CPU mode: the SIMD reference rasterizer renders the headless frames, no GL
+bool cpu_render = false;
+int cpu_threads = 0; // 0: one per hardware thread
+int cpu_tile_size = 64;
+
+// Simulated seconds between frames (headless and benchmark runs)
+double frame_timestep = 1.0 / 60.0;
+
+// Benchmark mode: N frames at fixed timesteps, timings reported at the end
+int bench_frames = 0;
+int bench_warmup = 10;
+const char *bench_output = NULL; // .json or .csv
+
+// Chrome trace of the CPU scope profiler, written at exit (PHONG_PROFILE)
+const char *trace_output = NULL;
+
+int main(int argc, char **argv) {
+    if (!parseArguments(argc, argv))
         return 1;
+
+    PROFILE_THREAD_NAME("main");
+
+    if (cpu_render) {
+        bool ok = runCpuRenderer();
+        return writeTrace() && ok ? 0 : 1;
     }
+
+    PROFILE_BEGIN(startup_scope, "startup");
+    PROFILE_BEGIN(context_scope, "create GL context");
+
     int width, height, nrChannels;
     // Before loading the image, we flip it vertically because
     // Images: 0.0 top of y-axis  OpenGL: 0.0 bottom of y-axis
     stbi_set_flip_vertically_on_load(1);
     unsigned char *data = stbi_load("texture.jpg", &width, &height, &nrChannels, 0);
 
-    //  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    //  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    //  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    //  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(gl_width, gl_height, "My spinning cube", NULL, NULL);
-    if (!window) {
-        fprintf(stderr, "ERROR: could not open window with GLFW3\n");
-        glfwTerminate();
-        return 1;
+    GLFWwindow* window = NULL;
+    if (headless) {
+#ifdef PHONG_HEADLESS
+        // start GL context without any window or display server
+        if (!headlessCreateContext())
+            return 1;
+#endif
+    } else {
+        // start GL context and O/S window using the GLFW helper library
+        if (!glfwInit()) {
+            fprintf(stderr, "ERROR: could not start GLFW3\n");
+            return 1;
+        }
+
+        //  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        //  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        //  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        //  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(gl_width, gl_height, "My spinning cube", NULL, NULL);
+        if (!window) {
+            fprintf(stderr, "ERROR: could not open window with GLFW3\n");
+            glfwTerminate();
+            return 1;
+        }
+        glfwSetWindowSizeCallback(window, glfw_window_size_callback);
+        glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
+        glfwMakeContextCurrent(window);
     }
-    glfwSetWindowSizeCallback(window, glfw_window_size_callback);
-    glfwMakeContextCurrent(window);
 
     // start GLEW extension handler
     // glewExperimental = GL_TRUE;
-    glewInit();
+    GLenum glew_status = glewInit();
+    // GLEW also probes GLX, which has no display under EGL: GL entry points
+    // are loaded anyway, so only treat other failures as fatal
+    if (headless && glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY) {
+        fprintf(stderr, "ERROR: could not start GLEW: %s\n", glewGetErrorString(glew_status));
+        return 1;
+    }
+
+#ifdef PHONG_HEADLESS
+    if (headless && !headlessCreateFramebuffer(gl_width, gl_height))
+        return 1;
+#endif
+    PROFILE_END(context_scope);
 
     // get version info
     const GLubyte* vendor = glGetString(GL_VENDOR); // get vendor string
@@ -109,59 +328,50 @@ int main() {
     char* vertex_shader = textFileRead(vertexFileName);
 
     // Fragment Shader
-    char* fragment_shader = textFileRead(fragmentFileName);
+    bool deferred = shading == SHADING_DEFERRED;
+    const char *fragment_file = deferred ? gbufferFragmentFileName
+                                         : light_count > 0 ? clusteredFragmentFileName : fragmentFileName;
+    char* fragment_shader = textFileRead(fragment_file);
 
-    // Shaders compilation
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vertex_shader, NULL);
-    free(vertex_shader);
-    glCompileShader(vs);
-
-    int  success;
-    char infoLog[512];
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vs, 512, NULL, infoLog);
-        printf("ERROR: Vertex Shader compilation failed!\n%s\n", infoLog);
+    if (deferred && !gbufferSupported()) {
+        printf("ERROR: multiple render targets (OpenGL 3.0) are not supported!\n");
 
         return(1);
     }
 
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fragment_shader, NULL);
-    free(fragment_shader);
-    glCompileShader(fs);
-
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fs, 512, NULL, infoLog);
-        printf("ERROR: Fragment Shader compilation failed!\n%s\n", infoLog);
+    if (!GLEW_VERSION_3_1 && !GLEW_ARB_uniform_buffer_object) {
+        printf("ERROR: uniform buffer objects (OpenGL 3.1) are not supported!\n");
 
         return(1);
     }
 
-    // Create program, attach shaders to it and link it
-    shader_program = glCreateProgram();
-    glAttachShader(shader_program, fs);
-    glAttachShader(shader_program, vs);
-    glLinkProgram(shader_program);
-
-    glValidateProgram(shader_program);
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
-    if(!success) {
-        glGetProgramInfoLog(shader_program, 512, NULL, infoLog);
-        printf("ERROR: Shader Program linking failed!\n%s\n", infoLog);
-
-        return(1);
+    // Shaders compilation and linking, or the cached binary of a previous
+    // run. Scene shader variants are built below, once the draws are known.
+    PROFILE_BEGIN(programs_scope, "build shader programs");
+    auto program_start = std::chrono::steady_clock::now();
+    size_t programs_cached = 0;
+    scene_shaders = new ShaderVariants(vertex_shader, fragment_shader,
+                                       deferred ? bindGBufferProgramAttributes : bindProgramAttributes,
+                                       initSceneProgram, shader_cache_dir);
+    free(vertex_shader);
+    free(fragment_shader);
+    if (deferred) {
+        char *lighting_vs = textFileRead(deferredVertexFileName);
+        char *lighting_fs = textFileRead(deferredFragmentFileName);
+        bool lighting_cached = false;
+        lighting_program = createProgram(lighting_vs, lighting_fs, NULL, shader_cache_dir, &lighting_cached);
+        free(lighting_vs);
+        free(lighting_fs);
+        if (!lighting_program)
+            return(1);
+        programs_cached += lighting_cached;
+
+        bindUniformBlock(lighting_program, "Camera", CAMERA_BLOCK_BINDING);
+        uniformCacheBuild(lighting_program);
+        setClusteredLightingProgram(lighting_program);
     }
-
-    // Release shader objects
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-
-    // Vertex Array Object
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    double program_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_start).count();
+    PROFILE_END(programs_scope);
 
     // Cube to be rendered
     //
@@ -173,225 +383,890 @@ int main() {
     //       6        5
     //
 
-    Cube cubeInstance;
-    GLfloat* cube_vertex_positions_pointer = cubeInstance.getVertices();
-    GLfloat cube_vertex_positions[108];
-    std::copy(cube_vertex_positions_pointer, cube_vertex_positions_pointer + 108, cube_vertex_positions);
-
-// Vertex Buffer Object (for vertex coordinates)
-    GLuint vbo = 0;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertex_positions), cube_vertex_positions, GL_STATIC_DRAW);
-
-    // Vertex attributes
+    // Vertex attributes, interleaved in a single VBO unless asked otherwise
     // 0: vertex position (x, y, z)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
     // 1: vertex normals (x, y, z)
-    GLfloat* cube_vertex_normals_pointer = cubeInstance.getNormals();
-    GLfloat cube_vertex_normals[108];
-    std::copy(cube_vertex_normals_pointer, cube_vertex_normals_pointer + 108, cube_vertex_normals);
-
-    // Vertex Buffer Object (for vertex normals)
-    GLuint vbo_normals = 0;
-    glGenBuffers(1, &vbo_normals);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertex_normals), cube_vertex_normals, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
-
     // 2: texture coordinates (u, v)
-    GLfloat* cube_vertex_texture_coordinates_pointer = cubeInstance.getUV();
-    GLfloat cube_vertex_texture_coordinates[72];
-    std::copy(cube_vertex_texture_coordinates_pointer, cube_vertex_texture_coordinates_pointer + 72, cube_vertex_texture_coordinates);
-
-    // Vertex Buffer Object (for vertex texture coordinates)
-    GLuint vbo_texture_coordinates = 0;
-    glGenBuffers(1, &vbo_texture_coordinates);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_texture_coordinates);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertex_texture_coordinates), cube_vertex_texture_coordinates, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(2);
-
-
-//    // Unbind vbo (it was conveniently registered by VertexAttribPointer)
-//    glBindBuffer(GL_ARRAY_BUFFER, 0);
-//
-//
-//
-//    // Unbind vao
-//    glBindVertexArray(0);
-
-    glGenVertexArrays(1, &tetraVAO);
-    glBindVertexArray(tetraVAO);
+    PROFILE_BEGIN(scene_scope, "create meshes and scene");
+    Cube cubeInstance;
+    cube_mesh = createMesh(cubeInstance.getVertices(), cubeInstance.getNormals(), cubeInstance.getUV(),
+                           Cube::VERTEX_COUNT, cubeInstance.getIndices(), Cube::INDEX_COUNT, vertex_layout);
 
     Tetrahedron tetrahedronInstance;
-    GLfloat* tetrahedron_vertex_positions_pointer = tetrahedronInstance.getVertices();
-    GLfloat tetrahedron_vertex_positions[36];
-    std::copy(tetrahedron_vertex_positions_pointer, tetrahedron_vertex_positions_pointer + 36, tetrahedron_vertex_positions);
+    tetrahedron_mesh = createMesh(tetrahedronInstance.getVertices(), tetrahedronInstance.getNormals(),
+                                  tetrahedronInstance.getUVs(), Tetrahedron::VERTEX_COUNT,
+                                  tetrahedronInstance.getIndices(), Tetrahedron::INDEX_COUNT, vertex_layout);
+    printf("Vertex layout: %s\n", vertexLayoutName(vertex_layout));
 
-    // Vertex Buffer Object (for vertex coordinates)
-    GLuint vbo_tetrahedron = 0;
-    glGenBuffers(1, &vbo_tetrahedron);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_tetrahedron);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tetrahedron_vertex_positions), tetrahedron_vertex_positions, GL_STATIC_DRAW);
+    // Per-instance model and normal matrices
+    if (!instancingSupported()) {
+        printf("ERROR: instanced arrays (OpenGL 3.3) are not supported!\n");
 
-    // Vertex attributes
-    // 0: vertex position (x, y, z)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    // 1: vertex normals (x, y, z)
-    GLfloat* tetrahedron_vertex_normals_pointer = tetrahedronInstance.getNormals();
-    GLfloat tetrahedron_vertex_normals[36];
-    std::copy(tetrahedron_vertex_normals_pointer, tetrahedron_vertex_normals_pointer + 36, tetrahedron_vertex_normals);
-
-    // Vertex Buffer Object (for vertex normals)
-    GLuint vbo_normals_tetrahedron = 0;
-    glGenBuffers(1, &vbo_normals_tetrahedron);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_normals_tetrahedron);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tetrahedron_vertex_normals), tetrahedron_vertex_normals, GL_STATIC_DRAW);
+        return(1);
+    }
+    createScene();
+    if (light_count > 0 || deferred) {
+        if (!clusteredLightingSupported()) {
+            printf("ERROR: texture buffer objects (OpenGL 3.1) are not supported!\n");
+
+            return(1);
+        }
+        createLights();
+        clustered_lighting = createClusteredLighting();
+        printf("Clustered lighting: %zu point lights\n", point_lights.size());
+    }
+    if (deferred) {
+        if (!resizeGBuffer(gbuffer, gl_width, gl_height))
+            return(1);
+        setGBufferSamplers(lighting_program);
+        lighting_shininess_location = uniformLocation(lighting_program, "shininess");
+        printf("Shading: deferred, %dx%d G-buffer\n", gbuffer.width, gbuffer.height);
+    }
+    printf("Scene: %zu cubes, %zu tetrahedra\n", cube_nodes.size(), tetrahedron_nodes.size());
+    PROFILE_END(scene_scope);
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
+    {
+        // Decode the JPEGs in parallel, upload each one as soon as it is ready
+        PROFILE_SCOPE("load textures");
+        auto start = std::chrono::steady_clock::now();
+        ThreadPool decode_pool(std::min((unsigned) texture_paths.size(), std::thread::hardware_concurrency()));
+        size_t cached = 0;
+        std::vector<GLuint> textures = loadTextures(texture_paths, decode_pool, texture_cache_dir, &cached);
+        diffuseMapCube = textures[0];
+        specularMapCube = textures[1];
+        diffuseMapTetr = textures[2];
+        specularMapTetr = textures[3];
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Loaded %zu textures in %.1f ms (%zu from cache, %u decode threads)\n",
+               textures.size(), elapsed_ms, cached, decode_pool.size());
+
+        if (submission == SUBMISSION_INDIRECT && !multiDrawSupported()) {
+            printf("WARNING: multi-draw indirect (OpenGL 4.3, ARB_shader_draw_parameters) is not supported, "
+                   "drawing meshes one by one\n");
+            submission = SUBMISSION_DIRECT;
+        }
+        if (submission == SUBMISSION_INDIRECT) {
+            material_maps = createTextureArray(textures);
+            if (!material_maps) {
+                printf("WARNING: the textures do not fit in a texture array, drawing meshes one by one\n");
+                submission = SUBMISSION_DIRECT;
+            }
+        }
+    }
 
-    // 2: texture coordinates (u, v)
-    GLfloat* tetrahedron_vertex_texture_coordinates_pointer = tetrahedronInstance.getUVs();
-    GLfloat tetrahedron_vertex_texture_coordinates[24];
-    std::copy(tetrahedron_vertex_texture_coordinates_pointer, tetrahedron_vertex_texture_coordinates_pointer + 24, tetrahedron_vertex_texture_coordinates);
-
-    // Vertex Buffer Object (for vertex texture coordinates)
-    GLuint vbo_texture_coordinates_tetrahedron = 0;
-    glGenBuffers(1, &vbo_texture_coordinates_tetrahedron);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_texture_coordinates_tetrahedron);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tetrahedron_vertex_texture_coordinates), tetrahedron_vertex_texture_coordinates, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(2);
-
-//    // Unbind vbo (it was conveniently registered by VertexAttribPointer)
-//    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glEnableVertexAttribArray(0);
-
-    std::string cubeDiffPath = "../etc/m2base.jpg";
-    std::string cubeMetalPath = "../etc/m2metall.jpg";
-    std::string tetrDiffPath = "../etc/mdbase.jpg";
-    std::string tetrMetalPath = "../etc/mdmetall.jpg";
-    diffuseMapCube = loadTexture(cubeDiffPath.c_str());
-    specularMapCube = loadTexture(cubeMetalPath.c_str());
-    diffuseMapTetr = loadTexture(tetrDiffPath.c_str());
-    specularMapTetr = loadTexture(tetrMetalPath.c_str());
-    // Uniforms
-    // - Model matrix
-    model_location = glGetUniformLocation(shader_program, "model");
-    // - View matrix
-    view_location = glGetUniformLocation(shader_program, "view");
-    // - Projection matrix
-    proj_location = glGetUniformLocation(shader_program, "projection");
-    // - Normal matrix: normal vectors from local to world coordinates
-    normal_matrix_location = glGetUniformLocation(shader_program, "normal_to_world");
-    // - Camera position
-    // - Light data
-    // - Material data
-    // [...]
+    if (streaming == STREAMING_RING && (!RingBuffer::supported() || !(GLEW_VERSION_4_2 || GLEW_ARB_base_instance))) {
+        printf("WARNING: persistent buffer mapping (OpenGL 4.4) or base instances (OpenGL 4.2) are not supported, "
+               "orphaning per-frame buffers\n");
+        streaming = STREAMING_ORPHAN;
+    }
+    if (streaming == STREAMING_RING && !frame_ring.create(ringFrameSize(), ring_frames)) {
+        printf("WARNING: orphaning per-frame buffers\n");
+        streaming = STREAMING_ORPHAN;
+    }
+    RingBuffer *ring = streaming == STREAMING_RING ? &frame_ring : NULL;
+
+    if (submission == SUBMISSION_INDIRECT) {
+        cube_pool_mesh = mesh_pool.add(cubeInstance.getVertices(), cubeInstance.getNormals(), cubeInstance.getUV(),
+                                       Cube::VERTEX_COUNT, cubeInstance.getIndices(), Cube::INDEX_COUNT);
+        tetrahedron_pool_mesh = mesh_pool.add(tetrahedronInstance.getVertices(), tetrahedronInstance.getNormals(),
+                                              tetrahedronInstance.getUVs(), Tetrahedron::VERTEX_COUNT,
+                                              tetrahedronInstance.getIndices(), Tetrahedron::INDEX_COUNT);
+        mesh_pool.upload(vertex_layout);
+        if (ring)
+            pool_instance_buffer = createStreamedInstanceBuffer(mesh_pool.geometry(), *ring);
+        else
+            pool_instance_buffer = createInstanceBuffer(mesh_pool.geometry(),
+                                                        (GLsizei) (cube_nodes.size() + tetrahedron_nodes.size()));
+        multi_draw.create(ring);
+    } else if (ring) {
+        cube_instance_buffer = createStreamedInstanceBuffer(cube_mesh, *ring);
+        tetrahedron_instance_buffer = createStreamedInstanceBuffer(tetrahedron_mesh, *ring);
+    } else {
+        cube_instance_buffer = createInstanceBuffer(cube_mesh, (GLsizei) cube_nodes.size());
+        tetrahedron_instance_buffer = createInstanceBuffer(tetrahedron_mesh, (GLsizei) tetrahedron_nodes.size());
+    }
+    printf("Submission: %s\n", submission == SUBMISSION_INDIRECT ? "one multi-draw indirect call, pooled meshes"
+                                                                  : "one draw call per mesh");
+    if (ring)
+        printf("Streaming: persistently mapped ring buffer, %zu frames of %.1f KB\n", frame_ring.frameCount(),
+               frame_ring.frameSize() / 1024.0);
+    else
+        printf("Streaming: orphaned buffers\n");
+    // Variants of this scene's draws, built now so no frame waits for a compile
+    PROFILE_BEGIN(variants_scope, "build shader variants");
+    program_start = std::chrono::steady_clock::now();
+    for (bool textured : {cube_textured, tetrahedron_textured}) {
+        if (!scene_shaders->program(sceneVariant(textured)))
+            return(1);
+    }
+    programs_cached += scene_shaders->cachedCount();
+    PROFILE_END(variants_scope);
+    program_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_start).count();
+    printf("Shader programs ready in %.1f ms (%zu scene variants, %zu programs from binary cache)\n",
+           program_ms, scene_shaders->size(), programs_cached);
+
+    startup_uniform_lookups = uniformLookupCount();
+
+    // Uniform buffers
+    camera_ubo = createUniformBuffer(sizeof(CameraBlock), CAMERA_BLOCK_BINDING);
+    lights_ubo = createUniformBuffer(sizeof(LightsBlock), LIGHTS_BLOCK_BINDING);
+    PROFILE_END(startup_scope);
+
+
+    if (bench_frames > 0) {
+        bool ok = runBenchmark(window);
+#ifdef PHONG_HEADLESS
+        if (headless)
+            headlessTerminate();
+        else
+#endif
+            glfwTerminate();
+
+        return writeTrace() && ok ? 0 : 1;
+    }
 
+#ifdef PHONG_HEADLESS
+    if (headless) {
+        // Fixed timesteps so every run renders exactly the same frames
+        for (int frame = 0; frame < headless_frames; frame++) {
+            PROFILE_SCOPE("frame");
+            render(frame * frame_timestep);
+        }
+        {
+            PROFILE_SCOPE("glFinish");
+            glFinish();
+        }
+
+        bool saved = headlessWritePPM(headless_output, gl_width, gl_height);
+        if (saved)
+            printf("Saved frame %d to %s\n", headless_frames - 1, headless_output);
+        if (pick_x >= 0.0)
+            pickInstance(pick_x, pick_y, (float) ((headless_frames - 1) * frame_timestep) * 0.3f);
+        headlessTerminate();
+
+        return writeTrace() && saved ? 0 : 1;
+    }
+#endif
 
 // Render loop
     while(!glfwWindowShouldClose(window)) {
+        PROFILE_SCOPE("frame");
+        {
+            PROFILE_SCOPE("processInput");
+            processInput(window);
+        }
+        {
+            PROFILE_SCOPE("render");
+            render(glfwGetTime());
+        }
+        {
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        {
+            PROFILE_SCOPE("glfwPollEvents");
+            glfwPollEvents();
+        }
+    }
+
+    glfwTerminate();
 
-        processInput(window);
+    return writeTrace() ? 0 : 1;
+}
 
-        render(glfwGetTime());
+// Saves the CPU profiler trace when --trace was given
+bool writeTrace() {
+#ifdef PHONG_PROFILE
+    if (trace_output)
+        return profilerWriteTrace(trace_output);
+#endif
+    return true;
+}
 
-        glfwSwapBuffers(window);
+// Fixed attribute locations, applied before linking (and thus stored in
+// cached program binaries too)
+void bindProgramAttributes(GLuint program) {
+    bindVertexAttributes(program);
+    bindInstanceAttributes(program);
+}
+
+// The geometry pass of deferred shading also fixes its G-buffer outputs
+void bindGBufferProgramAttributes(GLuint program) {
+    bindProgramAttributes(program);
+    bindGBufferOutputs(program);
+}
+
+// Smallest scene shader variant for a draw: clustered and deferred shading
+// take any number of lights from their light lists, forward shading loops
+// over exactly the main lights
+ShaderVariantKey sceneVariant(bool textured) {
+    ShaderVariantKey key;
+    if (light_count == 0 && shading == SHADING_FORWARD)
+        key.lights = main_light_count;
+    key.features = textured ? SHADER_TEXTURES : 0;
+    if (submission == SUBMISSION_INDIRECT)
+        key.features |= SHADER_MULTI_DRAW;
+    return key;
+}
 
-        glfwPollEvents();
+// State of a new scene shader variant that never changes while rendering
+// (view/projection matrices, camera position and lights live in the Camera
+// and Lights uniform blocks, texture array layers in the Draws block, model
+// and normal matrices are per-instance attributes)
+void initSceneProgram(GLuint program, const ShaderVariantKey &key) {
+    bindUniformBlock(program, "Camera", CAMERA_BLOCK_BINDING);
+    bindUniformBlock(program, "Lights", LIGHTS_BLOCK_BINDING);
+    bindUniformBlock(program, "Draws", DRAWS_BLOCK_BINDING);
+    uniformCacheBuild(program);
+    if (light_count > 0 && shading == SHADING_FORWARD)
+        setClusteredLightingProgram(program);
+
+    useProgram(program);
+    glUniform3fv(uniformLocation(program, "material.ambient"), 1, glm::value_ptr(material_ambient));
+    glUniform1f(uniformLocation(program, "material.shininess"), material_shininess);
+    if ((key.features & SHADER_TEXTURES) && (key.features & SHADER_MULTI_DRAW)) {
+        // Both maps are layers of the texture array on unit 0
+        glUniform1i(uniformLocation(program, "material_maps"), 0);
+    } else if (key.features & SHADER_TEXTURES) {
+        // Diffuse map on unit 0, specular map on unit 1
+        glUniform1i(uniformLocation(program, "material.diffuse"), 0);
+        glUniform1i(uniformLocation(program, "material.specular"), 1);
+    } else {
+        glUniform3fv(uniformLocation(program, "material.diffuse"), 1, glm::value_ptr(material_diffuse));
+        glUniform3fv(uniformLocation(program, "material.specular"), 1, glm::value_ptr(material_specular));
     }
+}
 
-    glfwTerminate();
+// Starts timing the next section of render() on the GPU
+void beginGpuPass(const char *name) {
+    if (pass_timer)
+        pass_timer->beginPass(name);
+}
 
+// Framebuffer the final image goes to: the offscreen one in headless mode
+GLuint outputFramebuffer() {
+#ifdef PHONG_HEADLESS
+    if (headless)
+        return headlessFramebuffer();
+#endif
     return 0;
 }
 
-void render(double currentTime) {
-    float f = (float)currentTime * 0.3f;
+// Renders bench_frames frames at fixed simulated timesteps, after a few
+// untimed warm-up frames, and reports per-frame CPU/GPU time statistics.
+bool runBenchmark(GLFWwindow *window) {
+    FrameBenchmark bench;
+    bench.setInfo("renderer", (const char *) glGetString(GL_RENDERER));
+    bench.setInfo("gl_version", (const char *) glGetString(GL_VERSION));
+    bench.setInfo("viewport", std::to_string(gl_width) + "x" + std::to_string(gl_height));
+    bench.setInfo("mode", headless ? "headless" : "window");
+    bench.setInfo("timestep", std::to_string(frame_timestep));
+    bench.setInfo("vertex_layout", vertexLayoutName(vertex_layout));
+    bench.setInfo("instances", std::to_string(instance_count));
+    bench.setInfo("lights", std::to_string(point_lights.empty() ? main_light_count : point_lights.size()));
+    bench.setInfo("shading", shading == SHADING_DEFERRED ? "deferred" : "forward");
+    bench.setInfo("shader_variants", std::to_string(scene_shaders->size()));
+
+    // Do not let vsync cap the measured throughput
+    if (window)
+        glfwSwapInterval(0);
+
+    GpuPassTimer passes;
+    if (GpuPassTimer::supported())
+        pass_timer = &passes;
+    RenderStateCounters state_start;
+    unsigned long long ring_waits_start = 0;
+    double ring_wait_ms_start = 0.0;
+
+    for (int frame = -bench_warmup; frame < bench_frames; frame++) {
+        // Warm-up frames replay the start of the sequence
+        double time = (frame < 0 ? frame + bench_warmup : frame) * frame_timestep;
+
+        PROFILE_SCOPE(frame < 0 ? "warm-up frame" : "frame");
+        if (frame == 0) {
+            scene_stats = SceneStats();
+            state_start = renderStateCounters();
+            ring_waits_start = frame_ring.fenceWaits();
+            ring_wait_ms_start = frame_ring.fenceWaitMs();
+        }
+        if (frame >= 0) {
+            bench.beginFrame();
+            passes.beginFrame();
+        }
+        render(time);
+        if (frame >= 0) {
+            passes.endFrame();
+            bench.endFrame();
+        }
+
+        if (window) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bench.finish();
+    passes.finish();
+    pass_timer = NULL;
+    if (GpuPassTimer::supported()) {
+        bench.setGpuFrameTimes(passes.frameTimes());
+        bench.setInfo("gpu_pass_frames_dropped", std::to_string(passes.droppedFrames()));
+    }
+    for (const GpuPassTimes &pass : passes.passes())
+        bench.addGpuPass(pass.name, pass.ms);
+
+    // The uniform cache must have answered every lookup since startup
+    unsigned long frame_lookups = uniformLookupCount() - startup_uniform_lookups;
+    bench.setInfo("uniform_lookups_after_startup", std::to_string(frame_lookups));
+
+    // GL binds the render state cache made and skipped per frame
+    double state_issued = (double) (renderStateCounters().issued - state_start.issued) / std::max(bench_frames, 1);
+    double state_elided = (double) (renderStateCounters().elided - state_start.elided) / std::max(bench_frames, 1);
+    bench.setInfo("gl_state_calls_issued", std::to_string(state_issued));
+    bench.setInfo("gl_state_calls_elided", std::to_string(state_elided));
+
+    const char *culling_name = culling == CULLING_BVH ? "bvh" : culling == CULLING_LINEAR ? "linear" : "off";
+    // (before the frame below adds to them)
+    SceneStats stats = scene_stats;
+    double stats_frames = std::max(stats.frames, 1ull);
+    double visible_fraction = stats.tested ? (double) stats.visible / stats.tested : 1.0;
+    bench.setInfo("culling", culling_name);
+    bench.setInfo("submission", submission == SUBMISSION_INDIRECT ? "indirect" : "direct");
+    bench.setInfo("draw_calls", std::to_string(stats.draw_calls / stats_frames));
+    bench.setInfo("streaming", streaming == STREAMING_RING ? "ring" : "orphan");
+    if (streaming == STREAMING_RING) {
+        bench.setInfo("ring_frames", std::to_string(frame_ring.frameCount()));
+        bench.setInfo("ring_fence_waits", std::to_string(frame_ring.fenceWaits() - ring_waits_start));
+        bench.setInfo("ring_fence_wait_ms", std::to_string(frame_ring.fenceWaitMs() - ring_wait_ms_start));
+    }
+    bench.setInfo("visible_instances", std::to_string(visible_fraction * 2 * instance_count));
+    bench.setInfo("culling_ms", std::to_string(stats.cull_ms / stats_frames));
+    bench.setInfo("scene_nodes", std::to_string(scene_graph.size()));
+    bench.setInfo("scene_nodes_updated", std::to_string(stats.nodes_updated / stats_frames));
+    bench.setInfo("scene_graph_ms", std::to_string(stats.graph_ms / stats_frames));
+    bench.setInfo("bvh_nodes", std::to_string(cube_bvh.nodeCount() + tetrahedron_bvh.nodeCount()));
+    bench.setInfo("bvh_build_ms", std::to_string(bvh_build_ms));
+    if (culling == CULLING_BVH) {
+        bench.setInfo("bvh_refit_ms", std::to_string(stats.refit_ms / stats_frames));
+        bench.setInfo("bvh_sah_cost", std::to_string(cube_bvh.sahCost()) + "," +
+                                      std::to_string(tetrahedron_bvh.sahCost()));
+    }
 
-    glViewport(0, 0, gl_width, gl_height);
+    // Depth complexity of the last frame: every fragment passing the depth
+    // test runs the lighting loop in forward shading, deferred lights each
+    // covered pixel once
+    glGenQueries(1, &fragment_query);
+    render((bench_frames - 1) * frame_timestep);
+    GLuint fragments = 0;
+    glGetQueryObjectuiv(fragment_query, GL_QUERY_RESULT, &fragments);
+    glDeleteQueries(1, &fragment_query);
+    fragment_query = 0;
+    double depth_complexity = (double) fragments / ((double) gl_width * gl_height);
+    bench.setInfo("depth_complexity", std::to_string(depth_complexity));
+
+    if (!point_lights.empty()) {
+        bench.setInfo("light_cluster_pairs", std::to_string(clustered_lighting.light_cluster_pairs));
+        bench.setInfo("max_cluster_lights", std::to_string(clustered_lighting.max_cluster_lights));
+    }
 
-    glUseProgram(shader_program);
+    bench.printSummary(stdout);
+    printf("  Depth complexity: %.2f fragments per pixel pass the depth test (%s shading)\n",
+           depth_complexity, shading == SHADING_DEFERRED ? "deferred" : "forward");
+    if (!point_lights.empty())
+        printf("  Clustered lighting: %zu light/cluster pairs, at most %u lights per cluster%s\n",
+               clustered_lighting.light_cluster_pairs, clustered_lighting.max_cluster_lights,
+               clustered_lighting.overflowed ? " (light lists truncated)" : "");
+    printf("  Frustum culling (%s): %.1f of %d instances drawn per frame (%.1f%%), %.3f ms per frame\n",
+           culling_name, visible_fraction * 2 * instance_count, 2 * instance_count, 100.0 * visible_fraction,
+           stats.cull_ms / stats_frames);
+    printf("  Draw calls: %.1f per frame (%s submission)\n", stats.draw_calls / stats_frames,
+           submission == SUBMISSION_INDIRECT ? "indirect" : "direct");
+    printf("  Scene graph: %zu nodes, %.1f recomputed in %.3f ms per frame\n", scene_graph.size(),
+           stats.nodes_updated / stats_frames, stats.graph_ms / stats_frames);
+    printf("  BVH: %zu nodes built in %.2f ms", cube_bvh.nodeCount() + tetrahedron_bvh.nodeCount(), bvh_build_ms);
+    if (culling == CULLING_BVH)
+        printf(", refit in %.3f ms per frame (SAH cost %.1f cubes, %.1f tetrahedra)", stats.refit_ms /
+               stats_frames, cube_bvh.sahCost(), tetrahedron_bvh.sahCost());
+    printf("\n");
+    printf("  Uniform location lookups: %lu at startup, %lu while rendering\n",
+           startup_uniform_lookups, frame_lookups);
+    printf("  GL state calls: %.1f issued, %.1f elided per frame\n", state_issued, state_elided);
+    if (streaming == STREAMING_RING)
+        printf("  Streaming: ring buffer of %zu x %.1f KB, CPU waited on %llu fences (%.3f ms) in %d frames\n",
+               frame_ring.frameCount(), frame_ring.frameSize() / 1024.0, frame_ring.fenceWaits() - ring_waits_start,
+               frame_ring.fenceWaitMs() - ring_wait_ms_start, bench_frames);
+    else
+        printf("  Streaming: orphaned buffers\n");
+    if (bench_output)
+        return bench.writeReport(bench_output);
 
-    glm::mat4 model_matrix, view_matrix, proj_matrix;
-    glm::mat4 model_matrix_2, view_matrix_2, proj_matrix_2;
+    return true;
+}
 
-    // Cube
-    model_matrix = glm::mat4(1.0f);
-    model_matrix = glm::translate(model_matrix, glm::vec3(-0.5f, 0.0f, 0.0f));
-    model_matrix = glm::rotate(model_matrix, f * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-//    model_matrix = glm::rotate(model_matrix, f * glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+// Renders headless_frames frames of the same scene with the CPU rasterizer
+// and saves the last one, reporting the pixel throughput. Needs no GL
+// context, so it runs on machines without any GPU or display.
+bool runCpuRenderer() {
+    WorkStealingPool pool(cpu_threads);
+    TiledRasterizer rasterizer(pool, cpu_tile_size);
+    printf("CPU renderer (%s), viewport %dx%d, %u threads, %dx%d tiles\n", rasterInstructionSet(),
+           gl_width, gl_height, pool.size(), rasterizer.tileSize(), rasterizer.tileSize());
+    createScene();
+    if (light_count > 0)
+        printf("WARNING: the CPU renderer only draws the two main lights, --lights is ignored\n");
+    if (shading == SHADING_DEFERRED)
+        printf("WARNING: the CPU renderer only shades forward, --shading is ignored\n");
+    if (!cube_textured || !tetrahedron_textured)
+        printf("WARNING: the CPU renderer only draws textured materials, --untextured is ignored\n");
+
+    // Same maps as the GL path, taken from the texture cache when possible
+    std::vector<RasterTexture> textures(texture_paths.size());
+    for (size_t i = 0; i < texture_paths.size(); i++) {
+        PROFILE_SCOPE("load texture");
+        const char *path = texture_paths[i].c_str();
+        DecodedImage image;
+        if (!texture_cache_dir || !textureCacheLoad(texture_cache_dir, path, image)) {
+            if (!decodeImage(path, image)) {
+                fprintf(stderr, "ERROR: failed to load texture %s\n", path);
+                return false;
+            }
+            if (texture_cache_dir)
+                textureCacheStore(texture_cache_dir, path, image);
+        }
+        rasterTextureFromImage(image, textures[i]);
+        freeImage(image);
+    }
 
-    view_matrix = glm::lookAt(camera_pos, camera_pos + camera_front, camera_up);
-    proj_matrix = glm::perspective(glm::radians(50.0f), (float)gl_width / (float)gl_height, 0.1f, 100.0f);
+    RasterMaterial cube_material, tetrahedron_material;
+    cube_material.diffuse = &textures[0];
+    cube_material.specular = &textures[1];
+    tetrahedron_material.diffuse = &textures[2];
+    tetrahedron_material.specular = &textures[3];
+    cube_material.shininess = tetrahedron_material.shininess = (int) lroundf(material_shininess);
 
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
-    glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(view_matrix));
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, glm::value_ptr(proj_matrix));
+    Cube cubeInstance;
+    Tetrahedron tetrahedronInstance;
+    RasterMesh cube, tetrahedron;
+    cube.positions = cubeInstance.getVertices();
+    cube.normals = cubeInstance.getNormals();
+    cube.uvs = cubeInstance.getUV();
+    cube.vertex_count = Cube::VERTEX_COUNT;
+    cube.indices = cubeInstance.getIndices();
+    cube.index_count = Cube::INDEX_COUNT;
+    tetrahedron.positions = tetrahedronInstance.getVertices();
+    tetrahedron.normals = tetrahedronInstance.getNormals();
+    tetrahedron.uvs = tetrahedronInstance.getUVs();
+    tetrahedron.vertex_count = Tetrahedron::VERTEX_COUNT;
+    tetrahedron.indices = tetrahedronInstance.getIndices();
+    tetrahedron.index_count = Tetrahedron::INDEX_COUNT;
+
+    RasterTarget target;
+    rasterCreateTarget(target, gl_width, gl_height);
+    std::vector<RasterDrawItem> items(2);
+    RasterStats stats;
+    std::vector<double> frame_ms;
+
+    for (int frame = 0; frame < headless_frames; frame++) {
+        PROFILE_SCOPE("frame");
+        auto start = std::chrono::steady_clock::now();
+        CameraBlock camera = cameraBlock();
+        updateInstances((float) (frame * frame_timestep) * 0.3f, camera.projection * camera.view);
+        cube_instances.resize(cube_visible.size());
+        packInstances(cube_nodes, cube_visible, cube_instances.data());
+        tetrahedron_instances.resize(tetrahedron_visible.size());
+        packInstances(tetrahedron_nodes, tetrahedron_visible, tetrahedron_instances.data());
+
+        LightsBlock lights = lightsBlock();
+        RasterFrame raster_frame;
+        raster_frame.view_projection = camera.projection * camera.view;
+        raster_frame.view_pos = glm::vec3(camera.view_pos);
+        for (int i = 0; i < main_light_count; i++) {
+            RasterLight light;
+            light.position = glm::vec3(lights.lights[i].position);
+            light.ambient = glm::vec3(lights.lights[i].ambient);
+            light.diffuse = glm::vec3(lights.lights[i].diffuse);
+            light.specular = glm::vec3(lights.lights[i].specular);
+            raster_frame.lights.push_back(light);
+        }
+
+        items[0] = {&cube, cube_instances.data(), cube_instances.size(), &cube_material};
+        items[1] = {&tetrahedron, tetrahedron_instances.data(), tetrahedron_instances.size(), &tetrahedron_material};
+        rasterizer.render(target, raster_frame, items, 0xff000000, &stats);
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
 
-    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model_matrix)));
-    glUniformMatrix3fv(normal_matrix_location, 1, GL_FALSE, glm::value_ptr(normal_matrix));
+    double total_ms = 0.0;
+    for (double ms : frame_ms)
+        total_ms += ms;
+    TimingSummary summary = summarizeTimings(frame_ms);
+    double pixels = (double) gl_width * gl_height * headless_frames;
+    printf("CPU renderer: %d frames in %.1f ms (median %.2f ms, p99 %.2f ms per frame)\n",
+           headless_frames, total_ms, summary.median_ms, summary.p99_ms);
+    printf("  %.2f Mpixels/s, %.2f Mfragments/s shaded (%llu triangle/tile pairs drawn, %llu tiles stolen)\n",
+           pixels / (total_ms * 1e3), stats.fragments_shaded / (total_ms * 1e3),
+           (unsigned long long) stats.triangles, (unsigned long long) pool.stolenTasks());
+
+    bool saved = rasterWritePPM(target, headless_output);
+    if (saved)
+        printf("Saved frame %d to %s\n", headless_frames - 1, headless_output);
+    if (pick_x >= 0.0)
+        pickInstance(pick_x, pick_y, (float) ((headless_frames - 1) * frame_timestep) * 0.3f);
+
+    return saved;
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMapCube);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMapCube);
+// Command line options:
+//   --headless           render offscreen (EGL surfaceless), no window
+//   --frames <n>         frames to render in headless mode (default 1)
+//   --timestep <s>       simulated seconds between headless/benchmark frames
+//   --output <file.ppm>  where the last headless frame is saved
+//   --size <w>x<h>       viewport size
+//   --vertex-layout <l>  "interleaved" (default) or "separate" vertex buffers
+//   --instances <n>      cubes and tetrahedra in the scene (default 1 each)
+//   --lights <n>         add n point lights, shaded with clustered lighting
+//   --shading <mode>     "forward" (default) or "deferred" shading
+//   --main-lights <n>    main lights switched on, 0 to 2 (default 2)
+//   --untextured <m>     flat colours for "cubes", "tetrahedra" or "all"
+//   --static <m>         no spinning for "cubes", "tetrahedra" or "all"
+//   --culling <mode>     frustum culling: "bvh" (default), "linear" or "off"
+//   --submission <mode>  "indirect" (default, one multi-draw) or "direct" draws
+//   --streaming <mode>   per-frame data: "ring" (default, persistent mapping)
+//                        or "orphan" buffer uploads
+//   --ring-frames <n>    frames in flight in the ring buffer (default 3)
+//   --pick <x>,<y>       print the object under a pixel of the last frame
+//   --cpu                render the headless frames with the CPU rasterizer
+//   --threads <n>        CPU rasterizer threads (default: all hardware threads)
+//   --tile-size <n>      CPU rasterizer screen tile size (default 64)
+//   --texture-cache <d>  directory of the decoded texture cache
+//   --no-texture-cache   always decode textures from their source files
+//   --shader-cache <d>   directory of the program binary cache
+//   --no-shader-cache    always compile and link the shaders
+//   --bench <n>          benchmark mode: time n frames, then exit
+//   --bench-warmup <n>   untimed frames before the benchmark (default 10)
+//   --bench-output <f>   write the benchmark results as .json or .csv
+//   --trace <f.json>     record CPU scopes, saved as a Chrome trace at exit
+bool parseArguments(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "--headless")) {
+#ifdef PHONG_HEADLESS
+            headless = true;
+#else
+            fprintf(stderr, "ERROR: built without headless support (PHONG_HEADLESS)\n");
+            return false;
+#endif
+        } else if (!strcmp(arg, "--lights") && value) {
+            light_count = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--main-lights") && value) {
+            main_light_count = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--untextured") && value) {
+            if (!strcmp(value, "cubes")) {
+                cube_textured = false;
+            } else if (!strcmp(value, "tetrahedra")) {
+                tetrahedron_textured = false;
+            } else if (!strcmp(value, "all")) {
+                cube_textured = tetrahedron_textured = false;
+            } else {
+                fprintf(stderr, "ERROR: unknown meshes '%s' for --untextured\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--shading") && value) {
+            if (!strcmp(value, "forward")) {
+                shading = SHADING_FORWARD;
+            } else if (!strcmp(value, "deferred")) {
+                shading = SHADING_DEFERRED;
+            } else {
+                fprintf(stderr, "ERROR: unknown shading mode '%s'\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--static") && value) {
+            if (!strcmp(value, "cubes")) {
+                cube_animated = false;
+            } else if (!strcmp(value, "tetrahedra")) {
+                tetrahedron_animated = false;
+            } else if (!strcmp(value, "all")) {
+                cube_animated = tetrahedron_animated = false;
+            } else {
+                fprintf(stderr, "ERROR: unknown meshes '%s' for --static\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--culling") && value) {
+            if (!strcmp(value, "bvh")) {
+                culling = CULLING_BVH;
+            } else if (!strcmp(value, "linear")) {
+                culling = CULLING_LINEAR;
+            } else if (!strcmp(value, "off")) {
+                culling = CULLING_OFF;
+            } else {
+                fprintf(stderr, "ERROR: unknown culling mode '%s'\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--submission") && value) {
+            if (!strcmp(value, "indirect")) {
+                submission = SUBMISSION_INDIRECT;
+            } else if (!strcmp(value, "direct")) {
+                submission = SUBMISSION_DIRECT;
+            } else {
+                fprintf(stderr, "ERROR: unknown submission '%s'\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--ring-frames") && value) {
+            ring_frames = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--streaming") && value) {
+            if (!strcmp(value, "ring")) {
+                streaming = STREAMING_RING;
+            } else if (!strcmp(value, "orphan")) {
+                streaming = STREAMING_ORPHAN;
+            } else {
+                fprintf(stderr, "ERROR: unknown streaming '%s'\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--pick") && value) {
+            if (sscanf(value, "%lf,%lf", &pick_x, &pick_y) != 2 || pick_x < 0.0 || pick_y < 0.0) {
+                fprintf(stderr, "ERROR: invalid pixel '%s', expected <x>,<y>\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--cpu")) {
+            cpu_render = true;
+        } else if (!strcmp(arg, "--threads") && value) {
+            cpu_threads = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--tile-size") && value) {
+            cpu_tile_size = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--frames") && value) {
+            headless_frames = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--timestep") && value) {
+            frame_timestep = atof(value);
+            i++;
+        } else if (!strcmp(arg, "--output") && value) {
+            headless_output = value;
+            i++;
+        } else if (!strcmp(arg, "--vertex-layout") && value) {
+            if (!strcmp(value, "interleaved")) {
+                vertex_layout = VERTEX_LAYOUT_INTERLEAVED;
+            } else if (!strcmp(value, "separate")) {
+                vertex_layout = VERTEX_LAYOUT_SEPARATE;
+            } else {
+                fprintf(stderr, "ERROR: unknown vertex layout '%s'\n", value);
+                return false;
+            }
+            i++;
+        } else if (!strcmp(arg, "--instances") && value) {
+            instance_count = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--texture-cache") && value) {
+            texture_cache_dir = value;
+            i++;
+        } else if (!strcmp(arg, "--no-texture-cache")) {
+            texture_cache_dir = NULL;
+        } else if (!strcmp(arg, "--shader-cache") && value) {
+            shader_cache_dir = value;
+            i++;
+        } else if (!strcmp(arg, "--no-shader-cache")) {
+            shader_cache_dir = NULL;
+        } else if (!strcmp(arg, "--bench") && value) {
+            bench_frames = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--bench-warmup") && value) {
+            bench_warmup = atoi(value);
+            i++;
+        } else if (!strcmp(arg, "--trace") && value) {
+#ifdef PHONG_PROFILE
+            trace_output = value;
+            profilerEnable(true);
+            i++;
+#else
+            fprintf(stderr, "ERROR: built without the CPU profiler (PHONG_PROFILE)\n");
+            return false;
+#endif
+        } else if (!strcmp(arg, "--bench-output") && value) {
+            bench_output = value;
+            i++;
+        } else if (!strcmp(arg, "--size") && value) {
+            if (sscanf(value, "%dx%d", &gl_width, &gl_height) != 2) {
+                fprintf(stderr, "ERROR: invalid size '%s', expected <width>x<height>\n", value);
+                return false;
+            }
+            i++;
+        } else {
+            fprintf(stderr, "ERROR: unknown or incomplete option '%s'\n", arg);
+            return false;
+        }
+    }
 
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, 108);
-//    glActiveTexture(GL_TEXTURE1);
+    if (headless_frames < 1 || instance_count < 1 || bench_frames < 0 || bench_warmup < 0 || light_count < 0 ||
+        cpu_threads < 0 || cpu_tile_size < 1 || gl_width < 1 || gl_height < 1) {
+        fprintf(stderr, "ERROR: frame counts and viewport size must be positive\n");
+        return false;
+    }
+    if (ring_frames < 1) {
+        fprintf(stderr, "ERROR: --ring-frames must be positive\n");
+        return false;
+    }
+    if (main_light_count < 0 || main_light_count > NR_POINT_LIGHTS) {
+        fprintf(stderr, "ERROR: --main-lights must be between 0 and %d\n", NR_POINT_LIGHTS);
+        return false;
+    }
 
-    // Tetrahedron
-    model_matrix_2 = glm::mat4(1.0f);
-    model_matrix_2 = glm::translate(model_matrix_2, glm::vec3(1.0f, 0.0f, 0.0f));
-    model_matrix_2 = glm::rotate(model_matrix_2, f * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    model_matrix_2 = glm::rotate(model_matrix_2, f * glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    return true;
+}
 
-    view_matrix_2 = glm::lookAt(camera_pos, camera_pos + camera_front, camera_up);
-    proj_matrix_2 = glm::perspective(glm::radians(50.0f), (float)gl_width / (float)gl_height, 0.1f, 100.0f);
+void render(double currentTime) {
+    float f = (float)currentTime * 0.3f;
+    bool deferred = shading == SHADING_DEFERRED;
 
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_matrix_2));
-    glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(view_matrix_2));
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, glm::value_ptr(proj_matrix_2));
+    // Deferred: the scene goes into the G-buffer, lit below
+    if (deferred) {
+        resizeGBuffer(gbuffer, gl_width, gl_height);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbuffer.fbo);
+    }
 
-    glm::mat3 normal_matrix_2 = glm::transpose(glm::inverse(glm::mat3(model_matrix_2)));
-    glUniformMatrix3fv(normal_matrix_location, 1, GL_FALSE, glm::value_ptr(normal_matrix_2));
+    beginGpuPass("setup");
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMapTetr);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMapTetr);
+    setViewport(0, 0, gl_width, gl_height);
+
+    RingBuffer *ring = streaming == STREAMING_RING ? &frame_ring : NULL;
+    if (ring)
+        ring->beginFrame();
+
+    // Camera and lights are shared by every object: written once each per
+    // frame, before drawing so the current frame already uses them
+    CameraBlock camera = cameraBlock();
+    streamUniformBlock(ring, camera_ubo, CAMERA_BLOCK_BINDING, &camera, sizeof(camera));
+
+    // (deferred shading binds its lights in the lighting pass)
+    if (!deferred && light_count > 0) {
+        PROFILE_SCOPE("light lists");
+        updateClusteredLighting(clustered_lighting, point_lights, camera.view, camera_fov_y,
+                                gl_width, gl_height, camera_near, camera_far);
+        bindClusteredLighting(clustered_lighting);
+    } else if (!deferred) {
+        LightsBlock lights = lightsBlock();
+        streamUniformBlock(ring, lights_ubo, LIGHTS_BLOCK_BINDING, &lights, sizeof(lights));
+    }
 
-    glBindVertexArray(tetraVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 12);
+    beginGpuPass("instances");
+    {
+        PROFILE_SCOPE("update instances");
+        updateInstances(f, camera.projection * camera.view);
+        GLsizei cube_count = (GLsizei) cube_visible.size(), tetrahedron_count = (GLsizei) tetrahedron_visible.size();
+        if (ring && submission == SUBMISSION_INDIRECT) {
+            // Matrices go straight from the scene graph to the GPU's buffer
+            InstanceData *instances = streamInstances(pool_instance_buffer, *ring, cube_count + tetrahedron_count);
+            if (instances) {
+                packInstances(cube_nodes, cube_visible, instances);
+                packInstances(tetrahedron_nodes, tetrahedron_visible, instances + cube_count);
+            }
+        } else if (ring) {
+            InstanceData *instances = streamInstances(cube_instance_buffer, *ring, cube_count);
+            if (instances)
+                packInstances(cube_nodes, cube_visible, instances);
+            instances = streamInstances(tetrahedron_instance_buffer, *ring, tetrahedron_count);
+            if (instances)
+                packInstances(tetrahedron_nodes, tetrahedron_visible, instances);
+        } else {
+            cube_instances.resize(cube_count);
+            packInstances(cube_nodes, cube_visible, cube_instances.data());
+            tetrahedron_instances.resize(tetrahedron_count);
+            packInstances(tetrahedron_nodes, tetrahedron_visible, tetrahedron_instances.data());
+            if (submission == SUBMISSION_INDIRECT) {
+                updateInstanceBuffer(pool_instance_buffer, {&cube_instances, &tetrahedron_instances});
+            } else {
+                updateInstanceBuffer(cube_instance_buffer, cube_instances.data(), cube_count);
+                updateInstanceBuffer(tetrahedron_instance_buffer, tetrahedron_instances.data(), tetrahedron_count);
+            }
+        }
+    }
+
+    PROFILE_BEGIN(draw_scope, "draw scene");
+    if (fragment_query)
+        glBeginQuery(GL_SAMPLES_PASSED, fragment_query);
+
+    // Cubes
+    render_queue.clear();
+    DrawItem cubes;
+    cubes.name = "cubes";
+    cubes.program = scene_shaders->program(sceneVariant(cube_textured));
+    if (cube_textured) {
+        cubes.textures[0] = diffuseMapCube;
+        cubes.textures[1] = specularMapCube;
+    }
+    cubes.mesh = &cube_mesh;
+    cubes.instances = &cube_instance_buffer;
+    if (submission == SUBMISSION_INDIRECT)
+        poolDraw(cubes, cube_pool_mesh, 0, (GLsizei) cube_visible.size(), 0);
+    render_queue.add(cubes, nearestInstanceDepth(cube_nodes, cube_visible));
+//    glActiveTexture(GL_TEXTURE1);
 
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[0].position"), 1, glm::value_ptr(light_pos));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[0].ambient"), 1, glm::value_ptr(light_ambient));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[0].diffuse"), 1, glm::value_ptr(light_diffuse));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[0].specular"), 1, glm::value_ptr(light_specular));
+    // Tetrahedra
+    DrawItem tetrahedra;
+    tetrahedra.name = "tetrahedra";
+    tetrahedra.program = scene_shaders->program(sceneVariant(tetrahedron_textured));
+    if (tetrahedron_textured) {
+        tetrahedra.textures[0] = diffuseMapTetr;
+        tetrahedra.textures[1] = specularMapTetr;
+    }
+    tetrahedra.mesh = &tetrahedron_mesh;
+    tetrahedra.instances = &tetrahedron_instance_buffer;
+    if (submission == SUBMISSION_INDIRECT)
+        poolDraw(tetrahedra, tetrahedron_pool_mesh, (GLuint) cube_visible.size(),
+                 (GLsizei) tetrahedron_visible.size(), 2);
+    render_queue.add(tetrahedra, nearestInstanceDepth(tetrahedron_nodes, tetrahedron_visible));
+
+    // Runs of pooled draws sharing their state take a single call
+    render_queue.sort();
+    for (size_t i = 0; i < render_queue.size();) {
+        size_t end = render_queue.batchEnd(i);
+        beginGpuPass(end - i > 1 ? "scene" : render_queue[i].name);
+        if (render_queue[i].pooled)
+            multi_draw.draw(render_queue, i, end);
+        else
+            drawItem(render_queue[i]);
+        scene_stats.draw_calls++;
+        i = end;
+    }
 
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[1].position"), 1, glm::value_ptr(light_pos_2));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[1].ambient"), 1, glm::value_ptr(light_ambient));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[1].diffuse"), 1, glm::value_ptr(light_diffuse));
-    glUniform3fv(glGetUniformLocation(shader_program, "lights[1].specular"), 1, glm::value_ptr(light_specular));
+    if (fragment_query)
+        glEndQuery(GL_SAMPLES_PASSED);
+    PROFILE_END(draw_scope);
+
+    // Lighting pass: one fragment per covered pixel, whatever the overdraw
+    if (deferred) {
+        PROFILE_SCOPE("lighting pass");
+        beginGpuPass("lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+
+        useProgram(lighting_program);
+        updateClusteredLighting(clustered_lighting, point_lights, camera.view, camera_fov_y,
+                                gl_width, gl_height, camera_near, camera_far);
+        bindClusteredLighting(clustered_lighting);
+        bindGBufferTextures(gbuffer);
+        glUniform1f(lighting_shininess_location, material_shininess);
+        drawFullscreenTriangle();
+
+        glEnable(GL_DEPTH_TEST);
+    }
 
-    glUniform3fv(glGetUniformLocation(shader_program, "material.ambient"), 1, glm::value_ptr(material_ambient));
-    glUniform1i(glGetUniformLocation(shader_program, "material.diffuse"), 0);
-    glUniform1i(glGetUniformLocation(shader_program, "material.specular"), 0);
-    glUniform1f(glGetUniformLocation(shader_program, "material.shininess"), material_shininess);
+    // Everything this frame wrote to the ring is behind the fence
+    if (ring)
+        ring->endFrame();
 
     // Moving cube
     // model_matrix = glm::rotate(model_matrix,
@@ -403,10 +1278,333 @@ void render(double currentTime) {
     //
     // Normal matrix: normal vectors to world coordinates
 
+}
 
+// View/projection matrices and camera position of the current viewport
+CameraBlock cameraBlock() {
+    CameraBlock camera;
+    camera.view = glm::lookAt(camera_pos, camera_pos + camera_front, camera_up);
+    camera.projection = glm::perspective(camera_fov_y, (float)gl_width / (float)gl_height, camera_near, camera_far);
     // Added view position to specular calculation
-    glUniform3fv(glGetUniformLocation(shader_program, "view_pos"), 1, glm::value_ptr(camera_pos));
+    camera.view_pos = glm::vec4(camera_pos, 1.0f);
+    return camera;
+}
+
+LightsBlock lightsBlock() {
+    LightsBlock lights;
+    lights.lights[0].position = glm::vec4(light_pos, 1.0f);
+    lights.lights[1].position = glm::vec4(light_pos_2, 1.0f);
+    for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+        lights.lights[i].ambient = glm::vec4(light_ambient, 0.0f);
+        lights.lights[i].diffuse = glm::vec4(light_diffuse, 0.0f);
+        lights.lights[i].specular = glm::vec4(light_specular, 0.0f);
+    }
+    return lights;
+}
+
+// The main lights, unattenuated over the whole scene, plus light_count
+// small coloured lights scattered through the bounds of the scene
+void createLights() {
+    LightsBlock main_lights = lightsBlock();
+    point_lights.clear();
+    for (int i = 0; i < main_light_count; i++) {
+        PointLight light;
+        light.position = glm::vec3(main_lights.lights[i].position);
+        light.radius = camera_far;
+        light.ambient = glm::vec3(main_lights.lights[i].ambient);
+        light.diffuse = glm::vec3(main_lights.lights[i].diffuse);
+        light.specular = glm::vec3(main_lights.lights[i].specular);
+        point_lights.push_back(light);
+    }
+
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (const std::vector<uint32_t> *nodes : {&cube_nodes, &tetrahedron_nodes}) {
+        for (uint32_t node : *nodes) {
+            glm::vec3 position(scene_graph.world(node).model[3]);
+            lo = glm::min(lo, position - glm::vec3(0.5f));
+            hi = glm::max(hi, position + glm::vec3(0.5f));
+        }
+    }
+
+    // Fixed seed: every run lights the scene the same way
+    unsigned int seed = 12345;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    for (int i = 0; i < light_count; i++) {
+        PointLight light;
+        light.position = lo + (hi - lo) * glm::vec3(random(), random(), random());
+        light.radius = 0.5f + 0.5f * random();
+        glm::vec3 color(0.2f + 0.8f * random(), 0.2f + 0.8f * random(), 0.2f + 0.8f * random());
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = 0.8f * color;
+        light.specular = 0.5f * color;
+        point_lights.push_back(light);
+    }
+}
+
+// Lays out instance_count cubes and as many tetrahedra. A single pair keeps
+// the original composition; larger scenes fill a grid in front of the camera.
+void createScene() {
+    std::vector<glm::vec3> cube_positions, tetrahedron_positions;
+    if (instance_count == 1) {
+        cube_positions.push_back(glm::vec3(-0.5f, 0.0f, 0.0f));
+        tetrahedron_positions.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
+    } else {
+        const float spacing = 0.75f;
+        int objects = 2 * instance_count;
+        int side = (int) ceil(cbrt((double) objects));
+        float half = 0.5f * (side - 1);
+        for (int i = 0; i < objects; i++) {
+            glm::vec3 cell(i % side, (i / side) % side, i / (side * side));
+            glm::vec3 position((cell.x - half) * spacing, (cell.y - half) * spacing, -cell.z * spacing);
+            // Alternate shapes so both spread over the whole grid
+            if (i % 2 == 0)
+                cube_positions.push_back(position);
+            else
+                tetrahedron_positions.push_back(position);
+        }
+    }
+
+    // Depth first: each group is followed by its instances
+    scene_graph.clear();
+    cube_nodes.clear();
+    tetrahedron_nodes.clear();
+    uint32_t root = scene_graph.addNode(SceneGraph::NO_PARENT, glm::vec3(0.0f));
+    uint32_t cubes = scene_graph.addNode(root, glm::vec3(0.0f));
+    for (const glm::vec3 &position : cube_positions)
+        cube_nodes.push_back(scene_graph.addNode(cubes, position));
+    uint32_t tetrahedra = scene_graph.addNode(root, glm::vec3(0.0f));
+    for (const glm::vec3 &position : tetrahedron_positions)
+        tetrahedron_nodes.push_back(scene_graph.addNode(tetrahedra, position));
+    scene_graph.update();
+
+    // Bounding spheres around each instance's centre hold the mesh whatever
+    // its rotation (the groups never move)
+    Cube cube;
+    Tetrahedron tetrahedron;
+    float cube_radius = boundingRadius(cube.getVertices(), Cube::VERTEX_COUNT);
+    float tetrahedron_radius = boundingRadius(tetrahedron.getVertices(), Tetrahedron::VERTEX_COUNT);
+    cube_bounds.clear();
+    for (uint32_t node : cube_nodes)
+        cube_bounds.add(glm::vec3(scene_graph.world(node).model[3]), cube_radius);
+    tetrahedron_bounds.clear();
+    for (uint32_t node : tetrahedron_nodes)
+        tetrahedron_bounds.add(glm::vec3(scene_graph.world(node).model[3]), tetrahedron_radius);
+
+    // The BVHs are built for the first frame and refit after that (static
+    // meshes keep these boxes)
+    cube_mesh_box = Aabb();
+    for (int i = 0; i < Cube::VERTEX_COUNT; i++)
+        cube_mesh_box.grow(glm::make_vec3(cube.getVertices() + 3 * i));
+    tetrahedron_mesh_box = Aabb();
+    for (int i = 0; i < Tetrahedron::VERTEX_COUNT; i++)
+        tetrahedron_mesh_box.grow(glm::make_vec3(tetrahedron.getVertices() + 3 * i));
+
+    auto start = std::chrono::steady_clock::now();
+    instanceBoxes(cube_mesh_box, cube_nodes, instance_boxes);
+    cube_bvh.build(instance_boxes);
+    instanceBoxes(tetrahedron_mesh_box, tetrahedron_nodes, instance_boxes);
+    tetrahedron_bvh.build(instance_boxes);
+    bvh_build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Spin shared by every cube (around the Y axis) and tetrahedron (Y and X)
+// at animation time f
+glm::quat cubeRotation(float f) {
+    return glm::angleAxis(f * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
 
+glm::quat tetrahedronRotation(float f) {
+    return glm::angleAxis(f * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+           glm::angleAxis(f * glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+}
+
+// Spins the instances of the animated meshes to time f and brings the scene
+// graph up to date, returning the nodes recomputed
+size_t animateScene(float f) {
+    if (cube_animated) {
+        glm::quat rotation = cubeRotation(f);
+        for (uint32_t node : cube_nodes)
+            scene_graph.setRotation(node, rotation);
+    }
+    if (tetrahedron_animated) {
+        glm::quat rotation = tetrahedronRotation(f);
+        for (uint32_t node : tetrahedron_nodes)
+            scene_graph.setRotation(node, rotation);
+    }
+    return scene_graph.update();
+}
+
+// World boxes of the instances of a mesh
+void instanceBoxes(const Aabb &mesh_box, const std::vector<uint32_t> &nodes, std::vector<Aabb> &boxes) {
+    boxes.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+        boxes[i] = transformAabb(mesh_box, scene_graph.world(nodes[i]).model);
+}
+
+// The BVHs of the meshes that moved
+void refitBvhs() {
+    if (cube_animated) {
+        instanceBoxes(cube_mesh_box, cube_nodes, instance_boxes);
+        cube_bvh.refit(instance_boxes);
+    }
+    if (tetrahedron_animated) {
+        instanceBoxes(tetrahedron_mesh_box, tetrahedron_nodes, instance_boxes);
+        tetrahedron_bvh.refit(instance_boxes);
+    }
+}
+
+// Every instance of a mesh, when culling is off
+static void allInstances(size_t count, std::vector<uint32_t> &visible) {
+    visible.resize(count);
+    for (size_t i = 0; i < count; i++)
+        visible[i] = (uint32_t) i;
+}
+
+// Animates the scene to time f and culls the instances to the ones visible
+// from `view_projection` (cube_visible, tetrahedron_visible); their matrices
+// are packed by packInstances().
+void updateInstances(float f, const glm::mat4 &view_projection) {
+    auto start = std::chrono::steady_clock::now();
+    scene_stats.nodes_updated += animateScene(f);
+    scene_stats.graph_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    Frustum frustum = frustumFromMatrix(view_projection);
+    if (culling == CULLING_BVH) {
+        refitBvhs();
+        scene_stats.refit_ms +=
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cube_bvh.cull(frustum, cube_visible);
+        tetrahedron_bvh.cull(frustum, tetrahedron_visible);
+    } else if (culling == CULLING_LINEAR) {
+        cullSpheres(frustum, cube_bounds, cube_visible);
+        cullSpheres(frustum, tetrahedron_bounds, tetrahedron_visible);
+    } else {
+        allInstances(cube_nodes.size(), cube_visible);
+        allInstances(tetrahedron_nodes.size(), tetrahedron_visible);
+    }
+    scene_stats.cull_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    scene_stats.frames++;
+    scene_stats.tested += cube_nodes.size() + tetrahedron_nodes.size();
+    scene_stats.visible += cube_visible.size() + tetrahedron_visible.size();
+}
+
+// Model and normal matrices of the `visible` instances of `nodes`, in
+// visible order. `out` may be mapped GPU memory: it is only written, in order.
+void packInstances(const std::vector<uint32_t> &nodes, const std::vector<uint32_t> &visible, InstanceData *out) {
+    for (size_t i = 0; i < visible.size(); i++)
+        out[i] = scene_graph.world(nodes[visible[i]]);
+}
+
+// View depth of the nearest visible instance origin, for the render queue's
+// front to back order (0 behind the camera, +inf without instances)
+float nearestInstanceDepth(const std::vector<uint32_t> &nodes, const std::vector<uint32_t> &visible) {
+    float nearest = INFINITY;
+    for (uint32_t instance : visible) {
+        glm::vec3 origin(scene_graph.world(nodes[instance]).model[3]);
+        nearest = std::min(nearest, glm::dot(origin - camera_pos, camera_front));
+    }
+    return std::max(nearest, 0.0f);
+}
+
+// Ring buffer room for a frame: every instance, the Camera, Lights and Draws
+// blocks and one multi-draw's commands, each padded to its alignment
+// (uniform buffer offsets need at most 256 bytes)
+GLsizeiptr ringFrameSize() {
+    const GLsizeiptr uniform_padding = 256;
+    GLsizeiptr size = (GLsizeiptr) ((cube_nodes.size() + tetrahedron_nodes.size() + 2) * sizeof(InstanceData));
+    size += sizeof(CameraBlock) + sizeof(LightsBlock) + sizeof(DrawsBlock) + 3 * uniform_padding;
+    size += MAX_MULTI_DRAWS * sizeof(DrawElementsIndirectCommand) + sizeof(GLuint);
+    return size;
+}
+
+// Moves a queued draw to the mesh pool: mesh `mesh` of it, `instance_count`
+// instances from `first_instance` of the shared buffer and, if textured, the
+// maps in texture array layers `first_layer` (diffuse) and the next one
+void poolDraw(DrawItem &item, uint32_t mesh, GLuint first_instance, GLsizei instance_count, GLint first_layer) {
+    item.mesh = &mesh_pool.geometry();
+    item.instances = &pool_instance_buffer;
+    item.pooled = &mesh_pool[mesh];
+    item.first_instance = first_instance;
+    item.instance_count = instance_count;
+    if (item.textures[0]) {
+        item.texture_target = GL_TEXTURE_2D_ARRAY;
+        item.textures[0] = material_maps;
+        item.textures[1] = 0;
+        item.layers[0] = first_layer;
+        item.layers[1] = first_layer + 1;
+    }
+}
+
+// Ray from the camera through window pixel (x, y), y pointing down
+Ray cameraRay(double x, double y) {
+    CameraBlock camera = cameraBlock();
+    glm::mat4 inverse = glm::inverse(camera.projection * camera.view);
+    float ndc_x = (float) (2.0 * x / gl_width - 1.0), ndc_y = (float) (1.0 - 2.0 * y / gl_height);
+    glm::vec4 far = inverse * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+
+    Ray ray;
+    ray.origin = camera_pos;
+    ray.direction = glm::normalize(glm::vec3(far) / far.w - camera_pos);
+    return ray;
+}
+
+// Triangles of one mesh and the scene graph nodes of its instances
+struct PickMesh {
+    const GLfloat *vertices;
+    const GLushort *indices;
+    int index_count;
+    const std::vector<uint32_t> *nodes;
+};
+
+// Nearest triangle of an instance (RayPrimitiveFunc), in object space
+static bool pickTriangles(uint32_t instance, const Ray &ray, float &t, void *user) {
+    const PickMesh &mesh = *(const PickMesh *) user;
+    glm::mat4 to_object = glm::inverse(scene_graph.world((*mesh.nodes)[instance]).model);
+    // Not renormalized: distances along both rays stay equal
+    Ray object_ray;
+    object_ray.origin = glm::vec3(to_object * glm::vec4(ray.origin, 1.0f));
+    object_ray.direction = glm::vec3(to_object * glm::vec4(ray.direction, 0.0f));
+
+    bool hit = false;
+    t = INFINITY;
+    for (int i = 0; i < mesh.index_count; i += 3) {
+        float triangle_t;
+        if (intersectRayTriangle(object_ray, glm::make_vec3(mesh.vertices + 3 * mesh.indices[i]),
+                                 glm::make_vec3(mesh.vertices + 3 * mesh.indices[i + 1]),
+                                 glm::make_vec3(mesh.vertices + 3 * mesh.indices[i + 2]), triangle_t) &&
+            triangle_t < t) {
+            t = triangle_t;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// Prints the object under window pixel (x, y) at animation time f
+void pickInstance(double x, double y, float f) {
+    Cube cube;
+    Tetrahedron tetrahedron;
+    PickMesh cubes = {cube.getVertices(), cube.getIndices(), Cube::INDEX_COUNT, &cube_nodes};
+    PickMesh tetrahedra = {tetrahedron.getVertices(), tetrahedron.getIndices(), Tetrahedron::INDEX_COUNT,
+                           &tetrahedron_nodes};
+    animateScene(f);
+    refitBvhs();
+
+    Ray ray = cameraRay(x, y);
+    float cube_t = INFINITY, tetrahedron_t = INFINITY;
+    int64_t cube_hit = cube_bvh.intersect(ray, cube_t, pickTriangles, &cubes);
+    int64_t tetrahedron_hit = tetrahedron_bvh.intersect(ray, tetrahedron_t, pickTriangles, &tetrahedra);
+    if (cube_hit >= 0 && cube_t <= tetrahedron_t)
+        printf("Pick (%.0f, %.0f): cube %lld at distance %.3f\n", x, y, (long long) cube_hit, cube_t);
+    else if (tetrahedron_hit >= 0)
+        printf("Pick (%.0f, %.0f): tetrahedron %lld at distance %.3f\n", x, y, (long long) tetrahedron_hit,
+               tetrahedron_t);
+    else
+        printf("Pick (%.0f, %.0f): nothing\n", x, y);
 }
 
 void processInput(GLFWwindow *window) {
@@ -421,40 +1619,11 @@ void glfw_window_size_callback(GLFWwindow* window, int width, int height) {
     printf("New viewport: (width: %d, height: %d)\n", width, height);
 }
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path){
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+// Left click: print the object under the cursor
+void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int /*mods*/) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    pickInstance(x, y, (float) glfwGetTime() * 0.3f);
 }
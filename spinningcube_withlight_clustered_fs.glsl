@@ -0,0 +1,121 @@
+#version 140
+
+// Variants (render/shader_variants.h): USE_TEXTURES, MULTI_DRAW
+
+struct Material {
+    vec3 ambient;
+#if defined(USE_TEXTURES) && !defined(MULTI_DRAW)
+    sampler2D diffuse;
+    sampler2D specular;
+#elif !defined(USE_TEXTURES)
+    vec3 diffuse;
+    vec3 specular;
+#endif
+    float shininess;
+};
+
+struct Light {
+    vec3 position;
+    float radius;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+out vec4 frag_col;
+
+in vec3 frag_3Dpos;
+in vec3 vs_normal;
+in vec2 vs_tex_coord;
+in vec3 vs_color;
+
+uniform Material material;
+
+#if defined(USE_TEXTURES) && defined(MULTI_DRAW)
+// Every map is a layer of one array, the draw picks its own (vertex shader)
+uniform sampler2DArray material_maps;
+flat in ivec2 vs_layers; // diffuse, specular
+#define DIFFUSE_MAP(uv) texture(material_maps, vec3(uv, vs_layers.x))
+#define SPECULAR_MAP(uv) texture(material_maps, vec3(uv, vs_layers.y))
+#elif defined(USE_TEXTURES)
+#define DIFFUSE_MAP(uv) texture(material.diffuse, uv)
+#define SPECULAR_MAP(uv) texture(material.specular, uv)
+#endif
+
+// Per-frame data, shared with the vertex shader
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+// Lights of every cluster (screen tile x depth slice), rebuilt every frame
+uniform samplerBuffer light_data;    // 4 texels per light
+uniform usamplerBuffer cluster_data; // first index and count per cluster
+uniform usamplerBuffer light_indices;
+layout(std140) uniform Clusters {
+    ivec2 cluster_tiles;
+    int cluster_tile_size;
+    int cluster_slices;
+    vec2 cluster_depth_scale_bias; // slice = log(view depth) * x + y
+};
+
+// Material colours at this fragment, fetched once for every light
+vec3 ambient_color, diffuse_color, specular_color;
+
+Light FetchLight(int index)
+{
+    vec4 position_radius = texelFetch(light_data, 4 * index);
+    Light light;
+    light.position = position_radius.xyz;
+    light.radius = position_radius.w;
+    light.ambient = texelFetch(light_data, 4 * index + 1).rgb;
+    light.diffuse = texelFetch(light_data, 4 * index + 2).rgb;
+    light.specular = texelFetch(light_data, 4 * index + 3).rgb;
+    return light;
+}
+
+vec3 CalcPointLight(Light light, vec3 vs_normal, vec3 frag_3Dpos, vec3 view_pos)
+{
+    vec3 ambient = light.ambient * ambient_color;
+
+    // Diffuse
+    vec3 light_dir = normalize(light.position - frag_3Dpos);
+    float diff = max(dot(vs_normal, light_dir), 0.0);
+    vec3 diffuse = light.diffuse * (diff * diffuse_color);
+    // Specular
+    vec3 view_dir = normalize(view_pos - frag_3Dpos);
+    vec3 reflect_dir = reflect(-light_dir, vs_normal);
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
+    vec3 specular = light.specular * spec * specular_color;
+
+    // Smooth window: full strength close to the light, none at its radius
+    float falloff = clamp(1.0 - pow(length(light.position - frag_3Dpos) / light.radius, 4.0), 0.0, 1.0);
+
+    vec3 result = vs_color * (diffuse + ambient + specular) * (falloff * falloff);
+    return result;
+}
+
+void main() {
+#ifdef USE_TEXTURES
+    diffuse_color = vec3(DIFFUSE_MAP(vs_tex_coord));
+    specular_color = vec3(SPECULAR_MAP(vs_tex_coord));
+    ambient_color = diffuse_color;
+#else
+    diffuse_color = material.diffuse;
+    specular_color = material.specular;
+    ambient_color = material.ambient;
+#endif
+
+    float view_depth = -(view * vec4(frag_3Dpos, 1.0)).z;
+    int slice = clamp(int(log(view_depth) * cluster_depth_scale_bias.x + cluster_depth_scale_bias.y), 0, cluster_slices - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy) / cluster_tile_size, cluster_tiles - 1);
+    uvec2 lights = texelFetch(cluster_data, tile.x + cluster_tiles.x * (tile.y + cluster_tiles.y * slice)).rg;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < lights.y; i++) {
+        int light = int(texelFetch(light_indices, int(lights.x + i)).r);
+        result += CalcPointLight(FetchLight(light), vs_normal, frag_3Dpos, view_pos);
+    }
+    frag_col = vec4(result, 1.0);
+}
@@ -0,0 +1,91 @@
+#version 140
+
+struct Light {
+    vec3 position;
+    float radius;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+out vec4 frag_col;
+
+// G-buffer written by spinningcube_withlight_gbuffer_fs.glsl
+uniform sampler2D g_position;
+uniform sampler2D g_normal;
+uniform sampler2D g_albedo;
+uniform sampler2D g_specular;
+uniform float shininess;
+
+// Per-frame data, shared with the geometry pass
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+// Lights of every cluster (screen tile x depth slice), rebuilt every frame
+uniform samplerBuffer light_data;    // 4 texels per light
+uniform usamplerBuffer cluster_data; // first index and count per cluster
+uniform usamplerBuffer light_indices;
+layout(std140) uniform Clusters {
+    ivec2 cluster_tiles;
+    int cluster_tile_size;
+    int cluster_slices;
+    vec2 cluster_depth_scale_bias; // slice = log(view depth) * x + y
+};
+
+Light FetchLight(int index)
+{
+    vec4 position_radius = texelFetch(light_data, 4 * index);
+    Light light;
+    light.position = position_radius.xyz;
+    light.radius = position_radius.w;
+    light.ambient = texelFetch(light_data, 4 * index + 1).rgb;
+    light.diffuse = texelFetch(light_data, 4 * index + 2).rgb;
+    light.specular = texelFetch(light_data, 4 * index + 3).rgb;
+    return light;
+}
+
+// CalcPointLight of the forward shaders, with the maps already sampled
+vec3 CalcPointLight(Light light, vec3 normal, vec3 frag_3Dpos, vec3 albedo, vec3 specular_map)
+{
+    vec3 ambient = light.ambient * albedo;
+
+    // Diffuse
+    vec3 light_dir = normalize(light.position - frag_3Dpos);
+    float diff = max(dot(normal, light_dir), 0.0);
+    vec3 diffuse = light.diffuse * (diff * albedo);
+    // Specular
+    vec3 view_dir = normalize(view_pos - frag_3Dpos);
+    vec3 reflect_dir = reflect(-light_dir, normal);
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
+    vec3 specular = light.specular * spec * specular_map;
+
+    // Smooth window: full strength close to the light, none at its radius
+    float falloff = clamp(1.0 - pow(length(light.position - frag_3Dpos) / light.radius, 4.0), 0.0, 1.0);
+
+    return (diffuse + ambient + specular) * (falloff * falloff);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(g_albedo, pixel, 0);
+    if (albedo.a == 0.0)
+        discard; // background, keeps the clear colour
+    vec3 frag_3Dpos = texelFetch(g_position, pixel, 0).xyz;
+    vec3 normal = texelFetch(g_normal, pixel, 0).xyz;
+    vec3 specular_map = texelFetch(g_specular, pixel, 0).rgb;
+
+    float view_depth = -(view * vec4(frag_3Dpos, 1.0)).z;
+    int slice = clamp(int(log(view_depth) * cluster_depth_scale_bias.x + cluster_depth_scale_bias.y), 0, cluster_slices - 1);
+    ivec2 tile = min(pixel / cluster_tile_size, cluster_tiles - 1);
+    uvec2 lights = texelFetch(cluster_data, tile.x + cluster_tiles.x * (tile.y + cluster_tiles.y * slice)).rg;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < lights.y; i++) {
+        int light = int(texelFetch(light_indices, int(lights.x + i)).r);
+        result += CalcPointLight(FetchLight(light), normal, frag_3Dpos, albedo.rgb, specular_map);
+    }
+    frag_col = vec4(result, 1.0);
+}
@@ -0,0 +1,7 @@
+#version 140
+
+// Fullscreen triangle, no vertex attributes: (-1,-1), (3,-1), (-1,3)
+void main() {
+    vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
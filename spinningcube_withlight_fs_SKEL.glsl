@@ -1,9 +1,16 @@
-#version 130
+#version 140
+
+// Variants (render/shader_variants.h): NR_POINT_LIGHTS, USE_TEXTURES, MULTI_DRAW
 
 struct Material {
     vec3 ambient;
+#if defined(USE_TEXTURES) && !defined(MULTI_DRAW)
     sampler2D diffuse;
     sampler2D specular;
+#elif !defined(USE_TEXTURES)
+    vec3 diffuse;
+    vec3 specular;
+#endif
     float shininess;
 };
 
@@ -22,37 +29,71 @@ in vec2 vs_tex_coord;
 in vec3 vs_color;
 
 uniform Material material;
+
+#if defined(USE_TEXTURES) && defined(MULTI_DRAW)
+// Every map is a layer of one array, the draw picks its own (vertex shader)
+uniform sampler2DArray material_maps;
+flat in ivec2 vs_layers; // diffuse, specular
+#define DIFFUSE_MAP(uv) texture(material_maps, vec3(uv, vs_layers.x))
+#define SPECULAR_MAP(uv) texture(material_maps, vec3(uv, vs_layers.y))
+#elif defined(USE_TEXTURES)
+#define DIFFUSE_MAP(uv) texture(material.diffuse, uv)
+#define SPECULAR_MAP(uv) texture(material.specular, uv)
+#endif
+
+// Per-frame data, shared with the vertex shader
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+#ifndef NR_POINT_LIGHTS
 #define NR_POINT_LIGHTS 2
-uniform Light lights[NR_POINT_LIGHTS];
-uniform vec3 view_pos;
+#endif
+#if NR_POINT_LIGHTS > 0
+layout(std140) uniform Lights {
+    Light lights[NR_POINT_LIGHTS];
+};
+#endif
+
+// Material colours at this fragment, fetched once for every light
+vec3 ambient_color, diffuse_color, specular_color;
 
 vec3 CalcPointLight(Light light, vec3 vs_normal, vec3 frag_3Dpos, vec3 view_pos)
 {
-//    vec3 ambient = light.ambient * material.ambient;
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vs_tex_coord));
+    vec3 ambient = light.ambient * ambient_color;
 
     // Diffuse
     vec3 light_dir = normalize(light.position - frag_3Dpos);
     float diff = max(dot(vs_normal, light_dir), 0.0);
-//    vec3 diffuse = light.diffuse * (diff * material.diffuse);
-    vec3 diffuse = light.diffuse * (diff * vec3(texture(material.diffuse, vs_tex_coord)));
+    vec3 diffuse = light.diffuse * (diff * diffuse_color);
     // Specular
     vec3 view_dir = normalize(view_pos - frag_3Dpos);
     vec3 reflect_dir = reflect(-light_dir, vs_normal);
     float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, vs_tex_coord));
+    vec3 specular = light.specular * spec * specular_color;
 
     vec3 result = vs_color * (diffuse + ambient + specular);
     return result;
 }
 
 void main() {
+#ifdef USE_TEXTURES
+    diffuse_color = vec3(DIFFUSE_MAP(vs_tex_coord));
+    specular_color = vec3(SPECULAR_MAP(vs_tex_coord));
+    ambient_color = diffuse_color;
+#else
+    diffuse_color = material.diffuse;
+    specular_color = material.specular;
+    ambient_color = material.ambient;
+#endif
 
     vec3 result = vec3(0.0);
+#if NR_POINT_LIGHTS > 0
     for (int i = 0; i < NR_POINT_LIGHTS; i++) {
         result += CalcPointLight(lights[i], vs_normal, frag_3Dpos, view_pos);
     }
+#endif
     frag_col = vec4(result, 1.0);
 }
-
-
@@ -0,0 +1,53 @@
+#version 140
+
+// Variants (render/shader_variants.h): USE_TEXTURES, MULTI_DRAW
+
+struct Material {
+    vec3 ambient;
+#if defined(USE_TEXTURES) && !defined(MULTI_DRAW)
+    sampler2D diffuse;
+    sampler2D specular;
+#elif !defined(USE_TEXTURES)
+    vec3 diffuse;
+    vec3 specular;
+#endif
+    float shininess;
+};
+
+// G-buffer: surface attributes of the nearest fragment, lit later by
+// spinningcube_withlight_deferred_fs.glsl
+out vec4 g_position;
+out vec4 g_normal;
+out vec4 g_albedo;
+out vec4 g_specular;
+
+in vec3 frag_3Dpos;
+in vec3 vs_normal;
+in vec2 vs_tex_coord;
+in vec3 vs_color;
+
+uniform Material material;
+
+#if defined(USE_TEXTURES) && defined(MULTI_DRAW)
+// Every map is a layer of one array, the draw picks its own (vertex shader)
+uniform sampler2DArray material_maps;
+flat in ivec2 vs_layers; // diffuse, specular
+#define DIFFUSE_MAP(uv) texture(material_maps, vec3(uv, vs_layers.x))
+#define SPECULAR_MAP(uv) texture(material_maps, vec3(uv, vs_layers.y))
+#elif defined(USE_TEXTURES)
+#define DIFFUSE_MAP(uv) texture(material.diffuse, uv)
+#define SPECULAR_MAP(uv) texture(material.specular, uv)
+#endif
+
+void main() {
+    g_position = vec4(frag_3Dpos, 1.0);
+    g_normal = vec4(vs_normal, 0.0);
+    // vs_color scales every light term, so it is folded into both colours
+#ifdef USE_TEXTURES
+    g_albedo = vec4(vs_color * vec3(DIFFUSE_MAP(vs_tex_coord)), 1.0);
+    g_specular = vec4(vs_color * vec3(SPECULAR_MAP(vs_tex_coord)), 1.0);
+#else
+    g_albedo = vec4(vs_color * material.diffuse, 1.0);
+    g_specular = vec4(vs_color * material.specular, 1.0);
+#endif
+}
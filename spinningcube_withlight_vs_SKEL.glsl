@@ -1,23 +1,48 @@
-#version 130
+#version 140
+
+// Variants (render/shader_variants.h): MULTI_DRAW
+#ifdef MULTI_DRAW
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 
 in vec3 v_pos;
 in vec3 v_normal;
 in vec2 v_tex;
 
+// Per-instance attributes: model and normal matrix of each object
+in mat4 i_model;
+in mat3 i_normal_to_world;
+
 out vec3 frag_3Dpos;
 out vec3 vs_normal;
 out vec2 vs_tex_coord;
 out vec3 vs_color;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat3 normal_to_world;
+#ifdef MULTI_DRAW
+// Per-draw data of a glMultiDrawElementsIndirect call (render/multi_draw.h):
+// texture array layers of the diffuse and specular maps
+layout(std140) uniform Draws {
+    ivec4 draws[256]; // MAX_MULTI_DRAWS
+};
+
+flat out ivec2 vs_layers;
+#endif
+
+// Per-frame data, updated once for every object
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
 
 void main() {
-  gl_Position = projection * view * model * vec4(v_pos, 1.0);
-  frag_3Dpos = vec3(model * vec4(v_pos, 1.0));
-  vs_normal = normalize(normal_to_world * v_normal);
+  vec4 world_pos = i_model * vec4(v_pos, 1.0);
+  gl_Position = projection * view * world_pos;
+  frag_3Dpos = vec3(world_pos);
+  vs_normal = normalize(i_normal_to_world * v_normal);
   vs_tex_coord = v_tex;
   vs_color = vec3(1,1,1);
+#ifdef MULTI_DRAW
+  vs_layers = draws[gl_DrawIDARB].xy;
+#endif
 }
@@ -0,0 +1,35 @@
+//
+// FNV-1a 64-bit hashing, used to key on-disk caches.
+//
+
+#ifndef GL_TEST_HASH_H
+#define GL_TEST_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+const uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+// Pass the previous result as `hash` to hash several buffers as one stream
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = FNV1A_OFFSET_BASIS) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a64(const std::string &text, uint64_t hash = FNV1A_OFFSET_BASIS) {
+    return fnv1a64(text.data(), text.size(), hash);
+}
+
+inline std::string hashToHex(uint64_t hash) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+    return hex;
+}
+
+#endif //GL_TEST_HASH_H
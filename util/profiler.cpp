@@ -0,0 +1,117 @@
+//
+// CPU scope profiler: per-thread event rings and Chrome trace export.
+//
+
+#include "profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t start_ns, end_ns;
+};
+
+// Written by its thread only: the head is published after each event, so
+// recording never locks
+struct ThreadRing {
+    unsigned id = 0;
+    std::string name;
+    std::unique_ptr<ProfileEvent[]> events;
+    std::atomic<uint64_t> head{0}; // events recorded so far
+};
+
+static std::atomic<bool> enabled{false};
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Rings outlive their threads, so pool workers can be traced after joining
+static std::mutex rings_mutex;
+static std::vector<std::unique_ptr<ThreadRing>> rings;
+static thread_local ThreadRing *thread_ring = NULL;
+
+static ThreadRing &threadRing() {
+    if (!thread_ring) {
+        std::unique_ptr<ThreadRing> ring(new ThreadRing);
+        ring->events.reset(new ProfileEvent[PROFILE_RING_CAPACITY]);
+
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        ring->id = (unsigned) rings.size() + 1;
+        thread_ring = ring.get();
+        rings.push_back(std::move(ring));
+    }
+    return *thread_ring;
+}
+
+void profilerEnable(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool profilerEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t profilerNow() {
+    // Never 0, which marks a scope opened while disabled
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+void profilerRecord(const char *name, uint64_t start_ns, uint64_t end_ns) {
+    ThreadRing &ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head & (PROFILE_RING_CAPACITY - 1)] = {name, start_ns, end_ns};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void profilerSetThreadName(const char *name) {
+    ThreadRing &ring = threadRing();
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    ring.name = name;
+}
+
+bool profilerWriteTrace(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    uint64_t written = 0, dropped = 0;
+    bool first = true;
+    fprintf(fp, "{\"traceEvents\": [");
+    for (const std::unique_ptr<ThreadRing> &ring : rings) {
+        if (!ring->name.empty()) {
+            fprintf(fp, "%s\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                    "\"args\": {\"name\": \"%s\"}}", first ? "" : ",", ring->id, ring->name.c_str());
+            first = false;
+        }
+
+        // Only the newest PROFILE_RING_CAPACITY events survive
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > PROFILE_RING_CAPACITY ? head - PROFILE_RING_CAPACITY : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const ProfileEvent &event = ring->events[i & (PROFILE_RING_CAPACITY - 1)];
+            fprintf(fp, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                    "\"ts\": %.3f, \"dur\": %.3f}", first ? "" : ",", event.name, ring->id,
+                    event.start_ns / 1e3, (event.end_ns - event.start_ns) / 1e3);
+            first = false;
+        }
+        written += head - begin;
+        dropped += begin;
+    }
+    fprintf(fp, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    fclose(fp);
+
+    printf("Trace: %llu events from %zu threads written to %s", (unsigned long long) written, rings.size(), path);
+    if (dropped)
+        printf(" (%llu oldest events overwritten)", (unsigned long long) dropped);
+    printf("\n");
+
+    return true;
+}
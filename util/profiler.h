@@ -0,0 +1,75 @@
+//
+// CPU scope profiler: PROFILE_SCOPE("name") records the time spent until the
+// end of the enclosing block into a ring buffer owned by the calling thread,
+// and profilerWriteTrace() dumps every thread's events as Chrome trace_event
+// JSON (chrome://tracing, https://ui.perfetto.dev).
+//
+// Spans that are not a block use PROFILE_BEGIN(var, "name") ... PROFILE_END(var).
+//
+// Only built with -DPHONG_PROFILE=ON; otherwise the macros expand to nothing.
+//
+
+#ifndef GL_TEST_PROFILER_H
+#define GL_TEST_PROFILER_H
+
+#include <stdint.h>
+
+#ifdef PHONG_PROFILE
+
+// Events kept per thread; older ones are overwritten
+const uint32_t PROFILE_RING_CAPACITY = 1 << 16;
+
+// Recording is off until enabled, scopes then cost two clock reads.
+void profilerEnable(bool enable);
+bool profilerEnabled();
+
+// Nanoseconds since the profiler epoch
+uint64_t profilerNow();
+
+// Appends a finished scope to the calling thread's ring. `name` must outlive
+// the profiler (a string literal).
+void profilerRecord(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+// Name shown for the calling thread in the trace
+void profilerSetThreadName(const char *name);
+
+// Writes the events of every thread. Recording threads must be idle.
+bool profilerWriteTrace(const char *path);
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name) : name(name), start(profilerEnabled() ? profilerNow() : 0) {}
+    ~ProfileScope() { end(); }
+
+    // Records the scope now rather than when it is destroyed
+    void end() {
+        if (start)
+            profilerRecord(name, start, profilerNow());
+        start = 0;
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_BEGIN(var, name) ProfileScope var(name)
+#define PROFILE_END(var) var.end()
+#define PROFILE_THREAD_NAME(name) profilerSetThreadName(name)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void) 0)
+#define PROFILE_BEGIN(var, name) ((void) 0)
+#define PROFILE_END(var) ((void) 0)
+#define PROFILE_THREAD_NAME(name) ((void) 0)
+
+#endif
+
+#endif //GL_TEST_PROFILER_H
@@ -0,0 +1,39 @@
+//
+// Fixed-size pool of worker threads consuming a FIFO job queue.
+//
+
+#ifndef GL_TEST_THREAD_POOL_H
+#define GL_TEST_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    // Finishes every queued job before joining the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> job);
+
+    unsigned size() const { return (unsigned) workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    bool stopping = false;
+};
+
+#endif //GL_TEST_THREAD_POOL_H
@@ -0,0 +1,110 @@
+//
+// Fork-join pool with one task deque per worker and work stealing.
+//
+
+#include "work_stealing_pool.h"
+#include "profiler.h"
+
+WorkStealingPool::WorkStealingPool(unsigned workers) {
+    if (workers == 0)
+        workers = std::thread::hardware_concurrency();
+    if (workers == 0)
+        workers = 1;
+
+    for (unsigned i = 0; i < workers; i++)
+        queues.emplace_back(new TaskQueue());
+    for (unsigned i = 1; i < workers; i++)
+        threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    batch_started.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+void WorkStealingPool::parallelFor(size_t count, const TaskFunc &func) {
+    if (count == 0)
+        return;
+
+    const size_t workers = queues.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t w = 0; w < workers; w++) {
+            std::lock_guard<std::mutex> queue_lock(queues[w]->mutex);
+            for (size_t task = count * w / workers; task < count * (w + 1) / workers; task++)
+                queues[w]->tasks.push_back(task);
+        }
+        job = &func;
+        finished_helpers = 0;
+        generation++;
+    }
+    batch_started.notify_all();
+
+    runTasks(0, func);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    batch_finished.wait(lock, [this] { return finished_helpers == threads.size(); });
+    job = NULL;
+}
+
+void WorkStealingPool::workerLoop(unsigned worker) {
+    PROFILE_THREAD_NAME("work-stealing pool");
+    uint64_t seen = 0;
+    for (;;) {
+        const TaskFunc *func;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            batch_started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            func = job;
+        }
+
+        runTasks(worker, *func);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished_helpers == threads.size())
+            batch_finished.notify_one();
+    }
+}
+
+void WorkStealingPool::runTasks(unsigned worker, const TaskFunc &func) {
+    size_t task;
+    while (popTask(worker, task))
+        func(task, worker);
+}
+
+bool WorkStealingPool::popTask(unsigned worker, size_t &task) {
+    // Own queue first, newest task (its neighbours are still warm in cache)
+    {
+        TaskQueue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then steal the oldest task of the next non-empty queue. No tasks are
+    // added during a batch, so finding every queue empty means we are done.
+    const unsigned workers = (unsigned) queues.size();
+    for (unsigned i = 1; i < workers; i++) {
+        TaskQueue &victim = *queues[(worker + i) % workers];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            stolen++;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,66 @@
+//
+// Fork-join pool with one task deque per worker and work stealing.
+//
+
+#ifndef GL_TEST_WORK_STEALING_POOL_H
+#define GL_TEST_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// parallelFor() splits the task range into one contiguous block per worker.
+// Workers pop their own block from the back and, once it is empty, steal
+// from the front of the others, so uneven tasks (busy vs empty screen tiles)
+// still keep every core working until the end.
+class WorkStealingPool {
+public:
+    typedef std::function<void(size_t task, unsigned worker)> TaskFunc;
+
+    // Workers including the calling thread; 0 means one per hardware thread
+    explicit WorkStealingPool(unsigned workers = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Runs func(task, worker) for every task in [0, count) and returns once
+    // all of them are done. The calling thread takes part as worker 0.
+    void parallelFor(size_t count, const TaskFunc &func);
+
+    unsigned size() const { return (unsigned) queues.size(); }
+    // Tasks run by a worker other than the one they were assigned to
+    uint64_t stolenTasks() const { return stolen; }
+
+private:
+    struct alignas(64) TaskQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void workerLoop(unsigned worker);
+    void runTasks(unsigned worker, const TaskFunc &func);
+    bool popTask(unsigned worker, size_t &task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+
+    // Batch hand-off: every helper checks in once per generation, so none
+    // can still be holding `job` when parallelFor() returns
+    std::mutex mutex;
+    std::condition_variable batch_started, batch_finished;
+    const TaskFunc *job = NULL;
+    uint64_t generation = 0;
+    unsigned finished_helpers = 0;
+    bool stopping = false;
+
+    std::atomic<uint64_t> stolen{0};
+};
+
+#endif //GL_TEST_WORK_STEALING_POOL_H